@@ -0,0 +1,893 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <numbers>
+#include <random>
+#include <string>
+
+#include "JFA_SDF.hpp"
+#include "MultiOCL_SDF.hpp"
+#include "SDF_Backend.hpp"
+#include "OCL_Context.hpp"
+#include "OCL_SDF.hpp"
+#include "Ray.hpp"
+#include "RayBatch.hpp"
+#include "ShapeContainer.hpp"
+#include "utils/utils.hpp"
+
+// Time and accuracy of the SDF backends, the ray marching and the scene handling, one section per function below.
+// The throughput comes first and is what --json writes, the other sections follow unless --throughput-only
+
+// Above this many shape-pixel evaluations the unbinned run is skipped, it would take minutes
+constexpr double MAX_UNBINNED_WORK = 2e9;
+constexpr int ITERATIONS = 5;
+
+constexpr int RAY_COUNT = 10'000;
+constexpr int RAY_SHAPES = 10; // About the interactive scene, denser ones stop most rays on their first step
+constexpr int BATCH_RAYS = 100'000;
+constexpr int PICKS = 100'000;
+constexpr int PROGRAM_SAMPLES = 4096; // Pixels checked against the host evaluation of the program
+constexpr int SCENE_FILE_SHAPES = 1'000'000;
+constexpr int FORMAT_SHAPES = 1000;
+constexpr int SCALE_SHAPES = 1000;
+constexpr int MULTI_SHAPES = 10'000;
+constexpr int BAND_SHAPES = 100; // Sparse enough that moving one circle changes tiles, denser scenes hide it behind other shapes
+
+struct SDFResult {
+  const char* backend;
+  sf::Vector2u size;
+  int shapes;
+  double ms;
+  std::string scene = "random";
+};
+
+struct RayResult {
+  const char* format;
+  int rays;
+  double ms;
+  Ray::Stats stats; // Of one pass over the rays
+};
+
+struct BatchResult {
+  const char* format;
+  size_t threads;
+  double ms;
+  double stepsPerRay;
+  size_t mismatches; // Against the scalar reference
+};
+
+// What ShapeContainer::pick did before the grid: every circle, then every rect
+static const sf::Shape* pickLinear(const ShapeContainer& shapes, sf::Vector2f point) {
+  for (const sf::CircleShape& circle : shapes.circles)
+    if (circle.getGlobalBounds().contains(point))
+      return &circle;
+
+  for (const sf::RectangleShape& rect : shapes.rects)
+    if (rect.getGlobalBounds().contains(point))
+      return &rect;
+
+  return nullptr;
+}
+
+// Same scene for the same count on every machine: 10% walls, the rest split between circles and rects
+static ShapeContainer makeScene(int numShapes, sf::Vector2u bounds) {
+  ShapeContainer shapes;
+  shapes.bounds = bounds;
+  shapes.seed(numShapes);
+
+  int numWalls = numShapes / 10;
+  int numCircles = (numShapes - numWalls) / 2;
+  shapes.generate(numCircles, numShapes - numWalls - numCircles, numWalls);
+
+  return shapes;
+}
+
+// Boxes, capsules, polygons and every fourth group a smooth union of a few of them
+static sdf::ShapeProgram makeProgram(int numGroups, u32 seed) {
+  std::mt19937 rng(seed);
+  auto between = [&](float min, float max) { return std::uniform_real_distribution<float>(min, max)(rng); };
+  auto randPos = [&]() { return sf::Vector2f{between(0.f, WIDTH), between(0.f, HEIGHT)}; };
+
+  sdf::ShapeProgram program;
+
+  auto addShape = [&](sf::Vector2f pos) {
+    switch (rng() % 4) {
+      case 0: program.addBox(pos, {between(5.f, 40.f), between(5.f, 40.f)}, between(0.f, 3.f), sf::Color::White); break;
+      case 1: program.addCapsule(pos, pos + sf::Vector2f{between(-60.f, 60.f), between(-60.f, 60.f)}, between(2.f, 20.f), sf::Color::White); break;
+      case 2: program.addCircle(pos, between(5.f, 40.f), sf::Color::White); break;
+      default: {
+        sf::Vector2f points[5];
+        for (int i = 0; i < 5; i++) {
+          float angle = 2.f * std::numbers::pi_v<float> * i / 5;
+          points[i] = pos + sf::Vector2f{std::cos(angle), std::sin(angle)} * between(10.f, 40.f);
+        }
+        program.addPolygon(points, sf::Color::White);
+      }
+    }
+  };
+
+  for (int i = 0; i < numGroups; i++) {
+    sf::Vector2f pos = randPos();
+
+    if (i % 4 == 0) {
+      program.beginGroup(between(5.f, 30.f));
+      for (int j = 0; j < 3; j++)
+        addShape(pos + sf::Vector2f{between(-40.f, 40.f), between(-40.f, 40.f)});
+      program.endGroup();
+    } else {
+      addShape(pos);
+    }
+  }
+
+  return program;
+}
+
+// Half circles, half rects and no walls
+static ShapeContainer makeOpenScene(int numShapes) {
+  ShapeContainer shapes;
+  shapes.seed(numShapes);
+  shapes.generate(numShapes / 2, numShapes - numShapes / 2, 0);
+
+  return shapes;
+}
+
+// Mean time of one call over ITERATIONS, whatever warm-up it needs is done before
+template<typename Fn>
+static double timeIterations(Fn&& iteration) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < ITERATIONS; i++)
+    iteration();
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() / ITERATIONS;
+}
+
+static double measure(SDF_Backend& sdf, const ShapeContainer& shapes) {
+  sdf.updateShapes(shapes);
+  sdf.run(); // Warm-up, also uploads everything
+
+  return timeIterations([&]() {
+    sdf.invalidate();
+    sdf.run();
+  });
+}
+
+static double measureSeeds(SDF_Backend& sdf, const sf::Image& scene) {
+  sdf.updateSeeds(scene);
+  sdf.run();
+
+  return timeIterations([&]() {
+    sdf.invalidate();
+    sdf.run();
+  });
+}
+
+// Runs submitted back to back, each frame taking whatever is ready, until the last one lands
+static double measurePipelined(SDF_Backend& sdf, const ShapeContainer& shapes) {
+  sdf.updateShapes(shapes);
+  sdf.run();
+  sdf.fetchPixels();
+
+  int runs = 0;
+  return timeIterations([&]() {
+    sdf.invalidate();
+    sdf.run();
+    sdf.fetchPixels(++runs < ITERATIONS ? SDF_Backend::Fetch::LatestReady : SDF_Backend::Fetch::Exact);
+  });
+}
+
+// What the scene texture would hold: opaque where the analytic distance is <= 0, transparent elsewhere
+static sf::Image rasterize(const ShapeContainer& shapes) {
+  sf::Image image({WIDTH, HEIGHT}, sf::Color::Transparent);
+
+  auto fill = [&](const auto& shape) {
+    sf::Vector2f ext = sdf::extent(shape);
+    int x0 = std::max(static_cast<int>(std::floor(shape.center.x - ext.x)), 0);
+    int y0 = std::max(static_cast<int>(std::floor(shape.center.y - ext.y)), 0);
+    int x1 = std::min(static_cast<int>(std::ceil(shape.center.x + ext.x)), WIDTH - 1);
+    int y1 = std::min(static_cast<int>(std::ceil(shape.center.y + ext.y)), HEIGHT - 1);
+
+    for (int y = y0; y <= y1; y++)
+      for (int x = x0; x <= x1; x++)
+        if (sdf::signedDst(sf::Vector2f(x, y), shape) <= 0.f)
+          image.setPixel({static_cast<unsigned>(x), static_cast<unsigned>(y)}, sf::Color::White);
+  };
+
+  for (const sf::CircleShape& circle : shapes.circles) {
+    float radius = circle.getRadius();
+    sf::Vector2f center = circle.getPosition() + sf::Vector2f{radius, radius};
+    fill(sdf::Circle{{{center.x, center.y}}, radius});
+  }
+
+  for (const sf::RectangleShape& rect : shapes.rects) {
+    sf::Vector2f halfSize = rect.getSize() / 2.f;
+    sf::Vector2f center = rect.getPosition() + halfSize;
+    fill(sdf::Rectangle{{{center.x, center.y}}, {{halfSize.x, halfSize.y}}});
+  }
+
+  return image;
+}
+
+struct FieldError {
+  double mean = 0.;
+  double max = 0.;
+};
+
+// In pixels, between the decoded fields (what the ray marching reads). Negative distances are clamped
+// since RGBA8 and the Jump Flooding engine don't have them
+static FieldError compareFields(SDF_Backend& actual, SDF_Backend& expected) {
+  const u8* actualPixels = actual.getPixels();
+  const u8* expectedPixels = expected.getPixels();
+
+  FieldError fieldError;
+  for (size_t i = 0; i < static_cast<size_t>(WIDTH) * HEIGHT; i++) {
+    float actualDst = std::max(sdf::load(actual.getFormat(), actualPixels, i), 0.f);
+    float expectedDst = std::max(sdf::load(expected.getFormat(), expectedPixels, i), 0.f);
+    double error = std::abs(actualDst - expectedDst) * WIDTH;
+    fieldError.mean += error;
+    fieldError.max = std::max(fieldError.max, error);
+  }
+  fieldError.mean /= static_cast<double>(WIDTH) * HEIGHT;
+
+  return fieldError;
+}
+
+// What RayBatch computes, one ray at a time straight from the stored field
+static RayBatch::Hit marchReference(const u8* pixels, sdf::Format format, sf::Vector2f origin, sf::Vector2f dir, float maxDist) {
+  RayBatch::Hit result = {0.f, origin, 0, false};
+  float t = 0.f;
+
+  for (u32 i = 0; i < 256 && t < maxDist; i++) {
+    sf::Vector2f pos = origin + dir * t;
+    if (pos.x < 0.f || pos.y < 0.f || pos.x >= WIDTH || pos.y >= HEIGHT)
+      break;
+
+    float dst = sdf::load(format, pixels, static_cast<size_t>(pos.y) * WIDTH + static_cast<size_t>(pos.x)) * WIDTH;
+    result.steps++;
+
+    if (dst < 1.f) {
+      result.hit = true;
+      break;
+    }
+
+    t += dst;
+  }
+
+  result.distance = std::min(t, maxDist);
+  result.position = origin + dir * result.distance;
+  return result;
+}
+
+// Full-image runs of every backend over 1 to 100k shapes at three resolutions
+static void benchThroughput(const std::vector<SDF_Backend::Type>& types, std::vector<SDFResult>& results) {
+  const sf::Vector2u resolutions[] = {{640, 360}, {1200, 720}, {1920, 1080}};
+
+  printf("%d runs each\n", ITERATIONS);
+  printf("%-8s %11s %8s %12s %14s %18s\n", "backend", "resolution", "shapes", "ms", "Mpixels/s", "Gshape-pixels/s");
+
+  for (SDF_Backend::Type type : types) {
+    for (sf::Vector2u size : resolutions) {
+      std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(size.x, size.y, type);
+
+      for (int numShapes = 1; numShapes <= 100'000; numShapes *= 10) {
+        double ms = measure(*sdf, makeScene(numShapes, size));
+        double pixels = static_cast<double>(size.x) * size.y;
+        results.push_back({sdf->getName(), size, numShapes, ms});
+
+        std::string resolution = std::to_string(size.x) + "x" + std::to_string(size.y);
+        printf("%-8s %11s %8d %12.2f %14.1f %18.2f\n", sdf->getName(), resolution.c_str(), numShapes, ms, pixels / ms / 1e3, pixels * numShapes / ms / 1e6);
+      }
+    }
+  }
+}
+
+// The given scene file on every backend, laid out for the window so replayed at its resolution only
+static void benchScene(const std::vector<SDF_Backend::Type>& types, const std::filesystem::path& path, std::vector<SDFResult>& results) {
+  ShapeContainer scene;
+  if (!scene.load(path))
+    error("Can't load scene [{}]", path.string());
+
+  int numShapes = static_cast<int>(scene.circles.size() + scene.rects.size() + scene.program.getGroupCount());
+  std::string name = path.filename().string();
+  printf("\n%s, %d shapes, %dx%d\n", name.c_str(), numShapes, WIDTH, HEIGHT);
+
+  for (SDF_Backend::Type type : types) {
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, type);
+    double ms = measure(*sdf, scene);
+    double pixels = static_cast<double>(WIDTH) * HEIGHT;
+    results.push_back({sdf->getName(), {WIDTH, HEIGHT}, numShapes, ms, name});
+
+    printf("%-8s %12.2f ms %14.1f Mpixels/s\n", sdf->getName(), ms, pixels / ms / 1e3);
+  }
+}
+
+// Ray::march over random origins and targets in the field the app marches (half floats, and RGBA8 for reference)
+static void benchRays(std::vector<RayResult>& results) {
+  printf("\n%d rays over %d shapes, %dx%d\n", RAY_COUNT, RAY_SHAPES, WIDTH, HEIGHT);
+  printf("%-8s %12s %14s %10s %12s %8s\n", "format", "ms", "Mrays/s", "steps/ray", "fetches/ray", "hits");
+
+  for (sdf::Format format : {sdf::Format::RGBA8, sdf::Format::R16F}) {
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, SDF_Backend::Type::CPU, format);
+    sdf->updateShapes(makeScene(RAY_SHAPES, {WIDTH, HEIGHT}));
+    sdf->run();
+    const u8* pixels = sdf->getPixels();
+
+    std::mt19937 rng(RAY_COUNT);
+    std::vector<Ray> rays;
+    rays.reserve(RAY_COUNT);
+
+    for (int i = 0; i < RAY_COUNT; i++) {
+      float x = rng() % WIDTH;
+      float y = rng() % HEIGHT;
+      int targetX = rng() % WIDTH;
+      int targetY = rng() % HEIGHT;
+
+      rays.emplace_back(sf::Vector2f{x, y}, 64, sf::Vector2u{WIDTH, HEIGHT});
+      rays.back().update({targetX, targetY});
+    }
+
+    // Only the marching is timed
+    double ms = timeIterations([&]() {
+      for (Ray& ray : rays)
+        ray.march(pixels, format, {WIDTH, HEIGHT});
+    });
+
+    RayResult result = {sdf::formatName(format), RAY_COUNT, ms, {}};
+    for (const Ray& ray : rays) {
+      const Ray::Stats& stats = ray.getStats();
+      result.stats.rays += stats.rays;
+      result.stats.hits += stats.hits;
+      result.stats.steps += stats.steps;
+      result.stats.fetches += stats.fetches;
+    }
+
+    results.push_back(result);
+    printf(
+      "%-8s %12.2f %14.2f %10.2f %12.2f %8zu\n", result.format, result.ms, RAY_COUNT / result.ms / 1e3,
+      static_cast<double>(result.stats.steps) / RAY_COUNT, static_cast<double>(result.stats.fetches) / RAY_COUNT, result.stats.hits
+    );
+  }
+}
+
+// RayBatch over random rays across the screen up to the diagonal, single threaded and on every core,
+// checked against the scalar reference
+static void benchRayBatches(std::vector<BatchResult>& results) {
+  std::mt19937 rng(BATCH_RAYS);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  std::vector<sf::Vector2f> origins(BATCH_RAYS);
+  std::vector<sf::Vector2f> directions(BATCH_RAYS);
+  std::vector<RayBatch::Hit> hits(BATCH_RAYS);
+
+  for (int i = 0; i < BATCH_RAYS; i++) {
+    origins[i] = {unit(rng) * WIDTH, unit(rng) * HEIGHT};
+    float angle = unit(rng) * 2.f * std::numbers::pi_v<float>;
+    directions[i] = {std::cos(angle), std::sin(angle)};
+  }
+
+  const float maxDist = sf::Vector2f(WIDTH, HEIGHT).length();
+
+  printf("\n%d batched rays over %d shapes, %dx%d, %zu lanes\n", BATCH_RAYS, RAY_SHAPES, WIDTH, HEIGHT, RayBatch::getLaneCount());
+  printf("%-8s %8s %12s %14s %10s %12s\n", "format", "threads", "ms", "Mrays/s", "steps/ray", "mismatches");
+
+  for (sdf::Format format : {sdf::Format::R32F, sdf::Format::R16F}) {
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, SDF_Backend::Type::CPU, format);
+    sdf->updateShapes(makeScene(RAY_SHAPES, {WIDTH, HEIGHT}));
+    sdf->run();
+    const u8* pixels = sdf->getPixels();
+
+    for (size_t threads : {size_t{1}, size_t{0}}) {
+      RayBatch batch(threads);
+      batch.setField(pixels, format, WIDTH, HEIGHT);
+
+      double ms = timeIterations([&]() { batch.marchBatch(origins, directions, maxDist, hits); });
+
+      BatchResult result = {sdf::formatName(format), threads ? threads : std::thread::hardware_concurrency(), ms, 0., 0};
+      for (int i = 0; i < BATCH_RAYS; i++) {
+        RayBatch::Hit expected = marchReference(pixels, format, origins[i], directions[i], maxDist);
+        result.stepsPerRay += hits[i].steps;
+        if (hits[i].hit != expected.hit || hits[i].steps != expected.steps || std::fabs(hits[i].distance - expected.distance) > 0.01f)
+          result.mismatches++;
+      }
+      result.stepsPerRay /= BATCH_RAYS;
+
+      results.push_back(result);
+      printf("%-8s %8zu %12.2f %14.2f %10.2f %12zu\n", result.format, result.threads, result.ms, BATCH_RAYS / result.ms / 1e3, result.stepsPerRay, result.mismatches);
+    }
+  }
+}
+
+// Construction of the OpenCL backend, mostly the program builds: empty binary cache, then filled
+struct Startup {
+  double coldMs = 0.;
+  double warmMs = 0.;
+};
+
+static Startup benchStartup() {
+  auto timeCreate = []() {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, SDF_Backend::Type::OpenCL);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  };
+
+  std::error_code ec;
+  std::filesystem::remove_all(OCL_Context::binaryCacheDir, ec);
+
+  Startup startup;
+  startup.coldMs = timeCreate();
+  startup.warmMs = timeCreate();
+
+  printf("\nOpenCL startup: %.1f ms cold, %.1f ms from the binary cache\n", startup.coldMs, startup.warmMs);
+  return startup;
+}
+
+static bool writeJson(const std::filesystem::path& path, const std::vector<SDFResult>& sdfResults, const std::vector<RayResult>& rayResults, const std::vector<BatchResult>& batchResults, const Startup& startup) {
+  FILE* file = fopen(path.string().c_str(), "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "{\n  \"iterations\": %d,\n", ITERATIONS);
+  fprintf(file, "  \"openclStartup\": {\"coldMs\": %.2f, \"warmMs\": %.2f},\n", startup.coldMs, startup.warmMs);
+  fprintf(file, "  \"sdf\": [");
+  for (size_t i = 0; i < sdfResults.size(); i++) {
+    const SDFResult& result = sdfResults[i];
+    double pixels = static_cast<double>(result.size.x) * result.size.y;
+    double seconds = result.ms / 1000.;
+
+    fprintf(
+      file, "%s\n    {\"backend\": \"%s\", \"scene\": \"%s\", \"width\": %u, \"height\": %u, \"shapes\": %d, \"ms\": %.4f, \"pixelsPerSec\": %.0f, \"shapePixelsPerSec\": %.0f}",
+      i ? "," : "", result.backend, result.scene.c_str(), result.size.x, result.size.y, result.shapes, result.ms, pixels / seconds, pixels * result.shapes / seconds
+    );
+  }
+
+  fprintf(file, "\n  ],\n  \"rayMarch\": [");
+  for (size_t i = 0; i < rayResults.size(); i++) {
+    const RayResult& result = rayResults[i];
+    fprintf(
+      file, "%s\n    {\"format\": \"%s\", \"width\": %d, \"height\": %d, \"rays\": %d, \"ms\": %.4f, \"raysPerSec\": %.0f, \"stepsPerRay\": %.2f, \"fetchesPerRay\": %.2f, \"hits\": %zu}",
+      i ? "," : "", result.format, WIDTH, HEIGHT, result.rays, result.ms, result.rays / (result.ms / 1000.),
+      static_cast<double>(result.stats.steps) / result.rays, static_cast<double>(result.stats.fetches) / result.rays, result.stats.hits
+    );
+  }
+  fprintf(file, "\n  ],\n  \"rayBatch\": [");
+  for (size_t i = 0; i < batchResults.size(); i++) {
+    const BatchResult& result = batchResults[i];
+    fprintf(
+      file, "%s\n    {\"format\": \"%s\", \"lanes\": %zu, \"threads\": %zu, \"rays\": %d, \"ms\": %.4f, \"raysPerSec\": %.0f, \"stepsPerRay\": %.2f, \"mismatches\": %zu}",
+      i ? "," : "", result.format, RayBatch::getLaneCount(), result.threads, BATCH_RAYS, result.ms, BATCH_RAYS / (result.ms / 1000.), result.stepsPerRay, result.mismatches
+    );
+  }
+  fprintf(file, "\n  ]\n}\n");
+
+  return fclose(file) == 0;
+}
+
+// Full-image SDF time against the number of shapes, with and without the tile binning
+static void benchBinning(const std::vector<SDF_Backend::Type>& types) {
+  printf("\n%dx%d, %d runs each\n", WIDTH, HEIGHT, ITERATIONS);
+  printf("%-8s %8s %12s %12s %10s %14s\n", "backend", "shapes", "binned ms", "unbinned ms", "speedup", "shapes/tile");
+
+  for (SDF_Backend::Type type : types) {
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, type);
+
+    for (int numShapes = 10; numShapes <= 100'000; numShapes *= 10) {
+      ShapeContainer shapes = makeOpenScene(numShapes);
+
+      sdf->setBinning(true);
+      double binnedMs = measure(*sdf, shapes);
+      double shapesPerTile = static_cast<double>(sdf->getBinning().getEntries().size()) / sdf->getTileCount();
+
+      double unbinnedMs = 0.;
+      if (static_cast<double>(numShapes) * WIDTH * HEIGHT <= MAX_UNBINNED_WORK) {
+        sdf->setBinning(false);
+        unbinnedMs = measure(*sdf, shapes);
+      }
+
+      if (unbinnedMs > 0.)
+        printf("%-8s %8d %12.2f %12.2f %9.1fx %14.1f\n", sdf->getName(), numShapes, binnedMs, unbinnedMs, unbinnedMs / binnedMs, shapesPerTile);
+      else
+        printf("%-8s %8d %12.2f %12s %10s %14.1f\n", sdf->getName(), numShapes, binnedMs, "-", "-", shapesPerTile);
+    }
+  }
+}
+
+// Time, bytes per frame and error against R32F of every storage format
+static void benchFormats(const std::vector<SDF_Backend::Type>& types) {
+  const sdf::Format formats[] = {sdf::Format::RGBA8, sdf::Format::R8, sdf::Format::R16F, sdf::Format::R32F};
+  ShapeContainer shapes = makeOpenScene(FORMAT_SHAPES);
+
+  printf("\n%d shapes\n", FORMAT_SHAPES);
+  printf("%-8s %8s %12s %12s %14s %14s\n", "backend", "format", "ms", "KiB/frame", "mean error px", "max error px");
+
+  for (SDF_Backend::Type type : types) {
+    std::unique_ptr<SDF_Backend> reference = SDF_Backend::create(WIDTH, HEIGHT, type, sdf::Format::R32F);
+    measure(*reference, shapes);
+
+    for (sdf::Format format : formats) {
+      std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, type, format);
+      double ms = measure(*sdf, shapes);
+      FieldError fieldError = compareFields(*sdf, *reference);
+      double kib = static_cast<double>(WIDTH) * HEIGHT * sdf::pixelSize(format) / 1024.;
+
+      printf("%-8s %8s %12.2f %12.0f %14.3f %14.3f\n", sdf->getName(), sdf::formatName(format), ms, kib, fieldError.mean, fieldError.max);
+    }
+  }
+}
+
+// Frame time of the OpenCL readback at several pipeline depths (0 waits for every frame)
+static void benchPipelined() {
+  ShapeContainer shapes = makeOpenScene(FORMAT_SHAPES);
+
+  printf("\n%d shapes, OpenCL\n", FORMAT_SHAPES);
+  printf("%-8s %12s\n", "depth", "ms/frame");
+
+  for (size_t depth : {0, 2, 3}) {
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, SDF_Backend::Type::OpenCL);
+    sdf->setPipelineDepth(depth);
+    printf("%-8zu %12.2f\n", depth, measurePipelined(*sdf, shapes));
+  }
+}
+
+// The specialized OpenCL kernels against the generic one
+static void benchVariants() {
+  struct VariantScene {
+    const char* name;
+    int numCircles;
+    int numRects;
+    int numWalls;
+  };
+  const VariantScene variantScenes[] = {
+    {"circles", 1000, 0, 0},
+    {"rects", 0, 1000, 0},
+    {"mixed", 500, 500, 0},
+    {"4 shapes", 2, 2, 0},
+    {"8 shapes", 3, 3, 2} // The interactive scene
+  };
+
+  printf("\nOpenCL kernel variants\n");
+  printf("%-10s %12s %14s %9s  %s\n", "scene", "generic ms", "specialized ms", "speedup", "variant");
+
+  OCL_SDF sdf(WIDTH, HEIGHT);
+
+  for (const VariantScene& scene : variantScenes) {
+    ShapeContainer shapes;
+    shapes.seed(scene.numCircles * 7 + scene.numRects);
+    shapes.generate(scene.numCircles, scene.numRects, scene.numWalls);
+
+    sdf.setSpecialization(false);
+    double genericMs = measure(sdf, shapes);
+    // The first run starts the variant's build, measured once it's in
+    sdf.setSpecialization(true);
+    sdf.updateShapes(shapes);
+    sdf.run();
+    sdf.finishBuilds();
+    double specializedMs = measure(sdf, shapes);
+
+    printf("%-10s %12.2f %14.2f %8.2fx %s\n", scene.name, genericMs, specializedMs, genericMs / specializedMs, sdf.getVariant().c_str());
+  }
+}
+
+// The Jump Flooding engines against the analytic field: time and distance error. Against RGBA8, its 8-bit steps
+// of WIDTH / 255 px are included in the error
+static void benchJumpFlooding() {
+  std::vector<std::unique_ptr<SDF_Backend>> floods;
+  floods.push_back(std::make_unique<JFA_SDF>(WIDTH, HEIGHT, false));
+  if (OCL_SDF::isAvailable())
+    floods.push_back(std::make_unique<JFA_SDF>(WIDTH, HEIGHT, true));
+
+  std::unique_ptr<SDF_Backend> analytic = SDF_Backend::create(WIDTH, HEIGHT);
+
+  printf("\n%-20s %8s %12s %12s %14s %14s\n", "engine", "shapes", "ms", "analytic ms", "mean error px", "max error px");
+
+  for (std::unique_ptr<SDF_Backend>& flood : floods) {
+    for (int numShapes = 10; numShapes <= 10'000; numShapes *= 10) {
+      ShapeContainer shapes = makeOpenScene(numShapes);
+
+      double analyticMs = measure(*analytic, shapes);
+      double floodMs = measureSeeds(*flood, rasterize(shapes));
+
+      FieldError fieldError = compareFields(*flood, *analytic);
+
+      printf("%-20s %8d %12.2f %12.2f %14.2f %14.2f\n", flood->getName(), numShapes, floodMs, analyticMs, fieldError.mean, fieldError.max);
+    }
+  }
+}
+
+// Shape programs (sdf::ShapeProgram) on every backend against their host evaluation
+static void benchPrograms(const std::vector<SDF_Backend::Type>& types) {
+  printf("\n%dx%d, shape programs, error over %d pixels\n", WIDTH, HEIGHT, PROGRAM_SAMPLES);
+  printf("%-8s %8s %12s %14s %14s\n", "backend", "groups", "ms", "shapes/tile", "max error px");
+
+  for (int numGroups = 10; numGroups <= 10'000; numGroups *= 10) {
+    ShapeContainer shapes;
+    shapes.setProgram(makeProgram(numGroups, numGroups));
+
+    std::mt19937 rng(numGroups);
+    std::vector<u32> samples(PROGRAM_SAMPLES);
+    std::vector<float> expected(PROGRAM_SAMPLES);
+
+    for (int i = 0; i < PROGRAM_SAMPLES; i++) {
+      samples[i] = rng() % (WIDTH * HEIGHT);
+      sf::Vector2f point{static_cast<float>(samples[i] % WIDTH), static_cast<float>(samples[i] / WIDTH)};
+
+      expected[i] = FLT_MAX;
+      for (size_t group = 0; group < shapes.program.getGroupCount(); group++)
+        expected[i] = std::min(expected[i], shapes.program.signedDst(point, group));
+    }
+
+    for (SDF_Backend::Type type : types) {
+      std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, type, sdf::Format::R32F);
+      double ms = measure(*sdf, shapes);
+      double shapesPerTile = static_cast<double>(sdf->getBinning().getEntries().size()) / sdf->getTileCount();
+
+      const u8* pixels = sdf->getPixels();
+      double maxError = 0.;
+      for (int i = 0; i < PROGRAM_SAMPLES; i++)
+        maxError = std::max(maxError, std::abs(static_cast<double>(sdf::load(sdf::Format::R32F, pixels, samples[i])) * WIDTH - expected[i]));
+
+      printf("%-8s %8d %12.2f %14.1f %14.3f\n", sdf->getName(), numGroups, ms, shapesPerTile, maxError);
+    }
+  }
+}
+
+// Loading a 1M-shape scene from text and binary files, and handing the mapped tables straight to the backends
+static void benchSceneFiles(const std::vector<SDF_Backend::Type>& types) {
+  ShapeContainer shapes = makeScene(SCENE_FILE_SHAPES, {WIDTH, HEIGHT});
+  std::filesystem::path textPath = std::filesystem::temp_directory_path() / "bench_scene.txt";
+  std::filesystem::path binaryPath = std::filesystem::temp_directory_path() / "bench_scene.sdfs";
+
+  if (!shapes.save(textPath) || !shapes.saveBinary(binaryPath))
+    error("Can't write the scene files to [{}]", std::filesystem::temp_directory_path().string());
+
+  auto elapsedMs = [](auto start) { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(); };
+
+  printf("\n%d shapes, %.1f MiB text, %.1f MiB binary\n", SCENE_FILE_SHAPES, std::filesystem::file_size(textPath) / 1048576., std::filesystem::file_size(binaryPath) / 1048576.);
+  printf("%-32s %12s %10s\n", "load", "ms", "shapes");
+
+  ShapeContainer fromText;
+  auto start = std::chrono::steady_clock::now();
+  fromText.load(textPath);
+  printf("%-32s %12.2f %10zu\n", "text -> ShapeContainer", elapsedMs(start), fromText.circles.size() + fromText.rects.size());
+
+  ShapeContainer fromBinary;
+  start = std::chrono::steady_clock::now();
+  fromBinary.load(binaryPath);
+  printf("%-32s %12.2f %10zu\n", "binary -> ShapeContainer", elapsedMs(start), fromBinary.circles.size() + fromBinary.rects.size());
+
+  for (SDF_Backend::Type type : types) {
+    std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(WIDTH, HEIGHT, type);
+
+    start = std::chrono::steady_clock::now();
+    sdf::SceneFile sceneFile;
+    sceneFile.open(binaryPath);
+    sdf->updateTables(sceneFile.getTables());
+    double ms = elapsedMs(start);
+    std::string label = std::format("binary mmap -> {}", sdf->getName());
+    printf("%-32s %12.2f %10zu\n", label.c_str(), ms, sceneFile.getTables().circles.size() + sceneFile.getTables().rects.size());
+
+    // Conversion through the SFML shapes, for comparison
+    start = std::chrono::steady_clock::now();
+    sdf->updateShapes(fromBinary);
+    label = std::format("ShapeContainer -> {}", sdf->getName());
+    printf("%-32s %12.2f %10zu\n", label.c_str(), elapsedMs(start), fromBinary.circles.size() + fromBinary.rects.size());
+  }
+
+  std::filesystem::remove(textPath);
+  std::filesystem::remove(binaryPath);
+}
+
+// The field at half and quarter of the window (SDF_Backend::setScale), read at every window pixel (its texel)
+// against the full resolution one
+static void benchScale(const std::vector<SDF_Backend::Type>& types) {
+  ShapeContainer shapes = makeScene(SCALE_SHAPES, {WIDTH, HEIGHT});
+
+  printf("\n%dx%d, %d shapes, field at a fraction of the window\n", WIDTH, HEIGHT, SCALE_SHAPES);
+  printf("%-8s %8s %12s %12s %14s %14s\n", "backend", "scale", "field", "ms", "mean error px", "max error px");
+
+  for (SDF_Backend::Type type : types) {
+    std::unique_ptr<SDF_Backend> full = SDF_Backend::create(WIDTH, HEIGHT, type, sdf::Format::R32F);
+    measure(*full, shapes);
+    const u8* fullPixels = full->getPixels();
+
+    for (float scale : {1.f, 0.5f, 0.25f}) {
+      sf::Vector2u fieldSize{static_cast<unsigned int>(WIDTH * scale), static_cast<unsigned int>(HEIGHT * scale)};
+      std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(fieldSize.x, fieldSize.y, type, sdf::Format::R32F);
+      sdf->setScale(static_cast<float>(fieldSize.x) / WIDTH);
+      double ms = measure(*sdf, shapes);
+
+      const u8* pixels = sdf->getPixels();
+      FieldError fieldError;
+      for (unsigned int y = 0; y < HEIGHT; y++) {
+        for (unsigned int x = 0; x < WIDTH; x++) {
+          size_t texel = static_cast<size_t>(y * fieldSize.y / HEIGHT) * fieldSize.x + x * fieldSize.x / WIDTH;
+          float dst = sdf::load(sdf::Format::R32F, pixels, texel);
+          float fullDst = sdf::load(sdf::Format::R32F, fullPixels, static_cast<size_t>(y) * WIDTH + x);
+          double error = std::abs(dst - fullDst) * WIDTH;
+          fieldError.mean += error;
+          fieldError.max = std::max(fieldError.max, error);
+        }
+      }
+      fieldError.mean /= static_cast<double>(WIDTH) * HEIGHT;
+
+      std::string field = std::format("{}x{}", fieldSize.x, fieldSize.y);
+      printf("%-8s %8.2f %12s %12.2f %14.2f %14.2f\n", sdf->getName(), scale, field.c_str(), ms, fieldError.mean, fieldError.max);
+    }
+  }
+}
+
+// MultiOCL_SDF with two bands on the device OCL_SDF runs on, so any machine with OpenCL goes through the band code.
+// Same device and kernel on both sides, the fields have to be identical: after full runs, and after a partial run over
+// rows the first band took from the second (uploaded from the host field, then read back with its computed tiles)
+static void benchBands() {
+  ShapeContainer shapes = makeScene(BAND_SHAPES, {WIDTH, HEIGHT});
+  cl_device_id device = OCL_Context::findDevice();
+  MultiOCL_SDF split(WIDTH, HEIGHT, {device, device});
+  OCL_SDF single(WIDTH, HEIGHT);
+  single.setSpecialization(false);
+
+  measure(split, shapes);
+  measure(single, shapes);
+  double fullError = compareFields(split, single).max;
+
+  const size_t tileRows = split.getDevices().back().endRow;
+  split.setBands({tileRows * 3 / 4, tileRows});
+
+  // A circle near the top dragged into the rows the first band gained, its tiles span rows it didn't compute
+  auto centerOf = [](const sf::CircleShape& circle) {
+    return circle.getPosition() + sf::Vector2f(circle.getRadius(), circle.getRadius());
+  };
+  auto top = std::find_if(shapes.circles.begin(), shapes.circles.end(), [&](const sf::CircleShape& circle) {
+    return centerOf(circle).y < HEIGHT / 8.f;
+  });
+  if (top == shapes.circles.end())
+    error("No circle in the top rows to move");
+
+  sf::Vector2i from(centerOf(*top));
+  sf::Vector2i to(from.x, HEIGHT * 5 / 8);
+  shapes.update(from, true);
+  shapes.update(to, true);
+  shapes.update(to, false);
+
+  split.updateShapes(shapes);
+  split.run();
+  single.updateShapes(shapes);
+  single.run();
+  double partialError = compareFields(split, single).max;
+  size_t partialTiles = split.getComputedTileCount();
+
+  printf("\n%dx%d, %d shapes, two bands on one device against OpenCL (generic kernel)\n", WIDTH, HEIGHT, BAND_SHAPES);
+  printf("full run max difference %.4f px, partial run (%zu tiles) max difference %.4f px\n", fullError, partialTiles, partialError);
+  if (partialTiles == 0)
+    error("The moved circle changed no tile, the partial run checked nothing");
+  if (fullError != 0. || partialError != 0.)
+    error("The banded field differs from the single-device one");
+}
+
+// The field split across every OpenCL device found against the usual single-device engine
+static void benchMultiDevice() {
+  ShapeContainer shapes = makeScene(MULTI_SHAPES, {WIDTH, HEIGHT});
+  MultiOCL_SDF multi(WIDTH, HEIGHT);
+  std::unique_ptr<SDF_Backend> single = SDF_Backend::create(WIDTH, HEIGHT, SDF_Backend::Type::OpenCL);
+
+  // The first runs size the bands
+  measure(multi, shapes);
+  double multiMs = measure(multi, shapes);
+  double singleMs = measure(*single, shapes);
+  FieldError fieldError = compareFields(multi, *single);
+
+  printf("\n%dx%d, %d shapes, OpenCL split across devices\n", WIDTH, HEIGHT, MULTI_SHAPES);
+  printf("%-40s %10s %12s %14s\n", "device", "tile rows", "kernel ms", "Mshape-px/ms");
+  for (const MultiOCL_SDF::DeviceInfo& info : multi.getDevices()) {
+    std::string rows = std::format("{}-{}", info.firstRow, info.endRow);
+    printf("%-40s %10s %12.2f %14.2f\n", info.name.c_str(), rows.c_str(), info.kernelMs, info.workPerMs / 1e6);
+  }
+  printf("every device %.2f ms, one device %.2f ms, max difference %.2f px\n", multiMs, singleMs, fieldError.max);
+}
+
+// Picking through the ShapeGrid against a scan of every shape
+static void benchPicking() {
+  printf("\n%d picks, %dx%d\n", PICKS, WIDTH, HEIGHT);
+  printf("%8s %12s %12s %10s %12s\n", "shapes", "grid ms", "scan ms", "speedup", "mismatches");
+
+  for (int numShapes = 100; numShapes <= 100'000; numShapes *= 10) {
+    ShapeContainer shapes = makeScene(numShapes, {WIDTH, HEIGHT});
+
+    std::mt19937 rng(numShapes);
+    std::vector<sf::Vector2f> points(PICKS);
+    for (sf::Vector2f& point : points)
+      point = {static_cast<float>(rng() % WIDTH), static_cast<float>(rng() % HEIGHT)};
+
+    std::vector<const sf::Shape*> gridPicks(PICKS);
+    std::vector<const sf::Shape*> scanPicks(PICKS);
+
+    auto gridStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < PICKS; i++)
+      gridPicks[i] = shapes.pick(points[i]);
+    auto gridEnd = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < PICKS; i++)
+      scanPicks[i] = pickLinear(shapes, points[i]);
+    auto scanEnd = std::chrono::steady_clock::now();
+
+    size_t mismatches = 0;
+    for (int i = 0; i < PICKS; i++)
+      mismatches += gridPicks[i] != scanPicks[i];
+
+    double gridMs = std::chrono::duration<double, std::milli>(gridEnd - gridStart).count();
+    double scanMs = std::chrono::duration<double, std::milli>(scanEnd - gridEnd).count();
+    printf("%8d %12.2f %12.2f %9.1fx %12zu\n", numShapes, gridMs, scanMs, scanMs / gridMs, mismatches);
+  }
+}
+
+int main(int argc, char** argv) {
+  std::filesystem::path jsonPath;
+  std::filesystem::path scenePath;
+  bool throughputOnly = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      jsonPath = std::filesystem::absolute(argv[++i]);
+    } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+      scenePath = std::filesystem::absolute(argv[++i]);
+    } else if (strcmp(argv[i], "--throughput-only") == 0) {
+      throughputOnly = true;
+    } else {
+      printf("Usage: Bench [--json <path>] [--scene <path>] [--throughput-only]\n");
+      return strcmp(argv[i], "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  // Assuming the executable is launching from its own directory
+  CHDIR("../../..");
+
+  std::vector<SDF_Backend::Type> types = {SDF_Backend::Type::CPU};
+  if (OCL_SDF::isAvailable())
+    types.push_back(SDF_Backend::Type::OpenCL);
+  if (OCL_Context::findDevices().size() > 1)
+    types.push_back(SDF_Backend::Type::MultiDevice);
+
+  std::vector<SDFResult> sdfResults;
+  std::vector<RayResult> rayResults;
+  std::vector<BatchResult> batchResults;
+  Startup startup;
+
+  benchThroughput(types, sdfResults);
+  if (!scenePath.empty())
+    benchScene(types, scenePath, sdfResults);
+  benchRays(rayResults);
+  benchRayBatches(batchResults);
+  if (OCL_SDF::isAvailable())
+    startup = benchStartup();
+
+  if (!jsonPath.empty()) {
+    if (!writeJson(jsonPath, sdfResults, rayResults, batchResults, startup))
+      error("Can't write [{}]", jsonPath.string());
+    printf("\nResults written to %s\n", jsonPath.string().c_str());
+  }
+
+  if (throughputOnly)
+    return EXIT_SUCCESS;
+
+  benchBinning(types);
+  benchFormats(types);
+  if (OCL_SDF::isAvailable()) {
+    benchPipelined();
+    benchVariants();
+  }
+  benchJumpFlooding();
+  benchPrograms(types);
+  benchSceneFiles(types);
+  benchScale(types);
+  if (OCL_SDF::isAvailable())
+    benchBands();
+  if (OCL_Context::findDevices().size() > 1)
+    benchMultiDevice();
+  benchPicking();
+}
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include <SFML/OpenGL.hpp>
+
+#include "RadianceCascades.hpp"
+#include "SDF_Backend.hpp"
+#include "SDF_Scene.hpp"
+#include "SDF_Texture.hpp"
+#include "ShapeContainer.hpp"
+#include "utils/utils.hpp"
+
+// Headless frames: the SDF of a scene, or its Radiance Cascades lighting, written to disk with the time of every stage.
+// The sdf output needs no GL context with the CPU and OpenCL backends, everything else renders off-screen
+// (SFML creates its own context, EGL on display-less nodes when SFML is built for it)
+
+struct Options {
+  std::filesystem::path root = ".";
+  std::filesystem::path scene;
+  std::filesystem::path outDir = "frames";
+  std::vector<unsigned int> seeds = {1};
+  int frames = 1;
+  SDF_Backend::Type backend = SDF_Backend::Type::Auto;
+  sdf::Format format = sdf::Format::R16F;
+  float scale = 1.f;
+  bool gi = true;
+  bool raw = false;
+  bool quiet = false;
+};
+
+static void usage() {
+  printf(
+    "Usage: Render [options]\n"
+    "  --root <dir>          Repository root, shaders and kernels are loaded from it (default .)\n"
+    "  --scene <file>        Scene file, text or binary (see ShapeContainer::load), random scenes otherwise\n"
+    "  --seeds <a,b-c,...>   Seeds of the random scenes (default 1)\n"
+    "  --frames <n>          Frames per scene (default 1)\n"
+    "  --backend <name>      auto, opencl, cpu, jfa, multi (default auto)\n"
+    "  --format <name>       rgba8, r8, r16f, r32f (default r16f)\n"
+    "  --scale <s>           Field and cascades at s of the frame, in (0, 1], gi upsampled back (default 1)\n"
+    "  --output <kind>       gi or sdf (default gi)\n"
+    "  --raw                 Raw pixels instead of PNG (RGBA8 for gi, the storage format for sdf)\n"
+    "  --out <dir>           Output directory (default frames)\n"
+    "  --quiet               Only print the summary\n"
+  );
+}
+
+static std::vector<unsigned int> parseSeeds(const std::string& list) {
+  std::vector<unsigned int> seeds;
+  std::istringstream items(list);
+  std::string item;
+
+  while (std::getline(items, item, ',')) {
+    size_t dash = item.find('-');
+    unsigned int first = std::stoul(item.substr(0, dash));
+    unsigned int last = dash == std::string::npos ? first : std::stoul(item.substr(dash + 1));
+    for (unsigned int seed = first; seed <= last; seed++)
+      seeds.push_back(seed);
+  }
+
+  return seeds;
+}
+
+static Options parseArgs(int argc, char** argv) {
+  Options options;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc)
+        error("Missing value for [{}]", arg);
+      return argv[++i];
+    };
+
+    if (arg == "--root") {
+      options.root = value();
+    } else if (arg == "--scene") {
+      options.scene = value();
+    } else if (arg == "--seeds") {
+      options.seeds = parseSeeds(value());
+    } else if (arg == "--frames") {
+      options.frames = std::max(std::stoi(value()), 1);
+    } else if (arg == "--backend") {
+      std::string name = value();
+      if (name == "auto")        options.backend = SDF_Backend::Type::Auto;
+      else if (name == "opencl") options.backend = SDF_Backend::Type::OpenCL;
+      else if (name == "cpu")    options.backend = SDF_Backend::Type::CPU;
+      else if (name == "jfa")    options.backend = SDF_Backend::Type::JumpFlood;
+      else if (name == "multi")  options.backend = SDF_Backend::Type::MultiDevice;
+      else error("Unknown backend [{}]", name);
+    } else if (arg == "--format") {
+      std::string name = value();
+      if (name == "rgba8")     options.format = sdf::Format::RGBA8;
+      else if (name == "r8")   options.format = sdf::Format::R8;
+      else if (name == "r16f") options.format = sdf::Format::R16F;
+      else if (name == "r32f") options.format = sdf::Format::R32F;
+      else error("Unknown format [{}]", name);
+    } else if (arg == "--scale") {
+      options.scale = std::stof(value());
+      if (!(options.scale > 0.f && options.scale <= 1.f))
+        error("Scale [{}] out of (0, 1]", options.scale);
+    } else if (arg == "--output") {
+      std::string kind = value();
+      if (kind != "gi" && kind != "sdf")
+        error("Unknown output [{}]", kind);
+      options.gi = kind == "gi";
+    } else if (arg == "--raw") {
+      options.raw = true;
+    } else if (arg == "--out") {
+      options.outDir = value();
+    } else if (arg == "--quiet") {
+      options.quiet = true;
+    } else {
+      usage();
+      exit(arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  return options;
+}
+
+// Gray, clamped to [0, 1] of the width like the RGBA8 field
+static sf::Image sdfImage(const u8* pixels, sdf::Format format, sf::Vector2u size) {
+  sf::Image image(size);
+
+  for (unsigned int y = 0; y < size.y; y++) {
+    for (unsigned int x = 0; x < size.x; x++) {
+      float dst = std::clamp(sdf::load(format, pixels, static_cast<size_t>(y) * size.x + x), 0.f, 1.f);
+      u8 v = static_cast<u8>(dst * 255.f + 0.5f);
+      image.setPixel({x, y}, sf::Color(v, v, v));
+    }
+  }
+
+  return image;
+}
+
+static void writeRaw(const std::filesystem::path& path, const u8* data, size_t size) {
+  std::ofstream file(path, std::ios::binary);
+  if (!file.write(reinterpret_cast<const char*>(data), size))
+    error("Can't write [{}]", path.string());
+}
+
+enum Stage { Upload, SDF, GI, Readback, Write, STAGE_COUNT };
+static const char* stageNames[STAGE_COUNT] = {"upload", "sdf", "gi", "readback", "write"};
+
+struct StageTimes {
+  double ms[STAGE_COUNT] = {};
+};
+
+int main(int argc, char** argv) {
+  Options options = parseArgs(argc, argv);
+
+  // Paths given on the command line are relative to where it was launched, resources to the root
+  if (!options.scene.empty())
+    options.scene = std::filesystem::absolute(options.scene);
+  options.outDir = std::filesystem::absolute(options.outDir);
+  std::filesystem::create_directories(options.outDir);
+  std::filesystem::current_path(options.root);
+
+  // The frames are WIDTH x HEIGHT, the field and the cascades cover them at options.scale
+  const sf::Vector2u frameSize{WIDTH, HEIGHT};
+  const sf::Vector2u fieldSize{
+    std::max(1u, static_cast<unsigned int>(std::lround(WIDTH * options.scale))),
+    std::max(1u, static_cast<unsigned int>(std::lround(HEIGHT * options.scale)))
+  };
+
+  std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(fieldSize.x, fieldSize.y, options.backend, options.format);
+  sdf->setScale(static_cast<float>(fieldSize.x) / frameSize.x);
+  printf("SDF backend: %s, %s, output %s\n", sdf->getName(), sdf::formatName(options.format), options.gi ? "gi" : "sdf");
+
+  // GL only when something has to be drawn: the lighting, or the scene the Jump Flooding works on
+  std::optional<sf::RenderTexture> shapesTexture;
+  std::optional<sf::RenderTexture> frameTexture;
+  std::optional<sf::RenderTexture> seedsTexture;
+  std::optional<sf::Texture> sdfTexture;
+  std::optional<RadianceCascades> radianceCascades;
+  bool sdfShared = false;
+
+  if (options.gi || sdf->usesSeeds())
+    shapesTexture.emplace(frameSize);
+
+  // The scene brought to the field's size
+  if (sdf->usesSeeds() && fieldSize != frameSize)
+    seedsTexture.emplace(fieldSize);
+
+  if (options.gi) {
+    frameTexture.emplace(frameSize);
+    sdfTexture.emplace(fieldSize);
+    sdf::allocateTexture(*sdfTexture, options.format);
+    sdfShared = sdf->shareTexture(*sdfTexture);
+    radianceCascades.emplace(fieldSize);
+  }
+
+  // A binary scene that isn't drawn goes to the backend's tables as it is, without building the shapes
+  sdf::SceneFile sceneFile;
+  const bool sceneTables = !options.scene.empty() && !shapesTexture && sceneFile.open(options.scene);
+
+  // One pass over the scenes file when one is given, the seeds otherwise
+  std::vector<unsigned int> seeds = options.scene.empty() ? options.seeds : std::vector<unsigned int>{0};
+  std::vector<StageTimes> times;
+
+  if (!options.quiet)
+    printf("%6s %6s %9s %9s %9s %9s %9s %9s\n", "seed", "frame", "upload", "sdf", "gi", "readback", "write", "total");
+
+  for (unsigned int seed : seeds) {
+    ShapeContainer shapes;
+    if (!options.scene.empty()) {
+      if (!sceneTables && !shapes.load(options.scene))
+        error("Can't load scene [{}]", options.scene.string());
+    } else {
+      shapes.seed(seed);
+      shapes.generate(3, 3, 2);
+    }
+
+    for (int frame = 0; frame < options.frames; frame++) {
+      StageTimes frameTimes;
+      auto last = std::chrono::steady_clock::now();
+      auto lap = [&](Stage stage) {
+        auto now = std::chrono::steady_clock::now();
+        frameTimes.ms[stage] = std::chrono::duration<double, std::milli>(now - last).count();
+        last = now;
+      };
+
+      // Every frame starts from scratch, the timings are those of a cold scene
+      sdf->invalidate();
+      if (sceneTables)
+        sdf->updateTables(sceneFile.getTables());
+      else
+        sdf->updateShapes(shapes);
+      if (shapesTexture) {
+        shapesTexture->clear(sf::Color::Transparent);
+        shapesTexture->draw(shapes);
+        shapesTexture->display();
+      }
+      if (seedsTexture) {
+        sf::Sprite scene(shapesTexture->getTexture());
+        scene.setScale(sf::Vector2f(fieldSize).componentWiseDiv(sf::Vector2f(frameSize)));
+        seedsTexture->clear(sf::Color::Transparent);
+        seedsTexture->draw(scene, sf::BlendNone);
+        seedsTexture->display();
+        sdf->updateSeeds(seedsTexture->getTexture().copyToImage());
+      } else if (sdf->usesSeeds()) {
+        sdf->updateSeeds(shapesTexture->getTexture().copyToImage());
+      }
+      lap(Upload);
+
+      sdf->run();
+      if (!sdfShared)
+        sdf->fetchPixels();
+      lap(SDF);
+
+      std::string name = std::format("{}_{}_{:04}", options.gi ? "gi" : "sdf", seed, frame);
+      std::filesystem::path path = options.outDir / (name + (options.raw ? ".raw" : ".png"));
+
+      if (options.gi) {
+        if (!sdfShared)
+          sdf::updateTexture(*sdfTexture, options.format, sdf->getPixels());
+        frameTexture->clear();
+        radianceCascades->render(*frameTexture, shapesTexture->getTexture(), *sdfTexture);
+        frameTexture->display();
+        glFinish();
+        lap(GI);
+
+        sf::Image image = frameTexture->getTexture().copyToImage();
+        lap(Readback);
+
+        if (options.raw)
+          writeRaw(path, image.getPixelsPtr(), static_cast<size_t>(frameSize.x) * frameSize.y * 4);
+        else if (!image.saveToFile(path))
+          error("Can't write [{}]", path.string());
+        lap(Write);
+      } else {
+        if (options.raw) {
+          writeRaw(path, sdf->getPixels(), static_cast<size_t>(fieldSize.x) * fieldSize.y * sdf::pixelSize(options.format));
+        } else if (!sdfImage(sdf->getPixels(), options.format, fieldSize).saveToFile(path)) {
+          error("Can't write [{}]", path.string());
+        }
+        lap(Write);
+      }
+
+      times.push_back(frameTimes);
+
+      if (!options.quiet) {
+        double total = 0.;
+        printf("%6u %6d", seed, frame);
+        for (double ms : frameTimes.ms) {
+          printf(" %9.2f", ms);
+          total += ms;
+        }
+        printf(" %9.2f\n", total);
+      }
+    }
+  }
+
+  printf("\n%zu frames, %ux%u, field %ux%u\n", times.size(), frameSize.x, frameSize.y, fieldSize.x, fieldSize.y);
+  printf("%-9s %9s %9s %9s\n", "stage", "mean ms", "min ms", "max ms");
+
+  for (int stage = 0; stage < STAGE_COUNT; stage++) {
+    double sum = 0., min = 1e300, max = 0.;
+    for (const StageTimes& frameTimes : times) {
+      sum += frameTimes.ms[stage];
+      min = std::min(min, frameTimes.ms[stage]);
+      max = std::max(max, frameTimes.ms[stage]);
+    }
+    printf("%-9s %9.2f %9.2f %9.2f\n", stageNames[stage], sum / times.size(), min, max);
+  }
+}
+
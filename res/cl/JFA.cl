@@ -0,0 +1,64 @@
+// Jump Flooding over the rendered scene. Every pixel keeps the closest seed found so far as (y << 16 | x), -1 if none.
+// A seed is any pixel the scene drew to (alpha > 0)
+
+int dstSquared(int x, int y, int seed) {
+  int dx = (seed & 0xFFFF) - x;
+  int dy = (seed >> 16) - y;
+  return dx * dx + dy * dy;
+}
+
+__kernel void jfaInit(__global const uchar4* scene, __global int* nearest) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  int i = y * get_global_size(0) + x;
+
+  nearest[i] = scene[i].w > 0 ? (y << 16 | x) : -1;
+}
+
+// One pass: look at the 8 neighbours step pixels away and keep the closest of their seeds
+__kernel void jfaStep(__global const int* src, __global int* dst, const int step) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  int width = get_global_size(0);
+  int height = get_global_size(1);
+
+  int best = src[y * width + x];
+  int bestDst = best < 0 ? INT_MAX : dstSquared(x, y, best);
+
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      int nx = x + dx * step;
+      int ny = y + dy * step;
+      if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= width || ny >= height)
+        continue;
+
+      int seed = src[ny * width + nx];
+      if (seed < 0)
+        continue;
+
+      int seedDst = dstSquared(x, y, seed);
+      if (seedDst < bestDst) {
+        best = seed;
+        bestDst = seedDst;
+      }
+    }
+  }
+
+  dst[y * width + x] = best;
+}
+
+// Same output as calcSDF, distance / maxDst in the format of img
+__kernel void jfaDistance(__global const int* nearest, __write_only image2d_t img, const float maxDst) {
+  int x = get_global_id(0);
+  int y = get_global_id(1);
+  int width = get_global_size(0);
+
+  int seed = nearest[y * width + x];
+
+  // The edge lies between the seed and its outside neighbour, half a pixel off on average
+  float dst = seed < 0 ? maxDst : fmax(sqrt((float)dstSquared(x, y, seed)) - 0.5f, 0.f);
+  float3 col = dst / maxDst;
+
+  write_imagef(img, (int2)(x, y), (float4)(col, 1.f));
+}
+
@@ -1,23 +1,33 @@
-// NOTE: Add padding for better alignment (16-byte)?
-typedef struct {
-  float2 center;
-  float radius;
-  float3 color;
-} Circle;
-
-typedef struct {
-  float2 center;
-  float2 sizeFromCenter;
-  float3 color;
-} Rectangle;
+// Variants, from the build options (see OCL_SDF::selectVariant):
+//   HAS_CIRCLES=0 / HAS_RECTS=0  the scene has none of them, their code is left out
+//   HAS_GROUPS=0                 no shape program (see ShapeLayout.h), its interpreter is left out
+//   FIXED_SHAPES                 FIXED_CIRCLES and FIXED_RECTS shapes known at build time, every tile scans them all, unrolled
+//   CONSTANT_SHAPES              the shape tables are read through constant memory
+#ifndef HAS_CIRCLES
+  #define HAS_CIRCLES 1
+#endif
+#ifndef HAS_RECTS
+  #define HAS_RECTS 1
+#endif
+#ifndef HAS_GROUPS
+  #define HAS_GROUPS 1
+#endif
+
+#ifdef CONSTANT_SHAPES
+  #define SHAPE_SPACE __constant
+#else
+  #define SHAPE_SPACE __global
+#endif
+
+#include "ShapeLayout.h"
 
 float signedDstToCircle(const float2 point, const Circle circle) {
-  return length(circle.center - point) - circle.radius;
+  return length(circle.xy - point) - circle.z;
 }
 
 float signedDstToRectangle(const float2 point, const Rectangle rect) {
-  float2 v = point - rect.center;
-  float2 offset = fabs(v) - rect.sizeFromCenter;
+  float2 v = point - rect.xy;
+  float2 offset = fabs(v) - rect.zw;
   float unsignedDst = length(fmax(offset, 0.f));
 
   float2 dstInsideBoxV = fmin(offset, 0.f);
@@ -26,19 +36,111 @@ float signedDstToRectangle(const float2 point, const Rectangle rect) {
   return unsignedDst + dstInsideBox;
 }
 
+#if HAS_GROUPS
+float smoothUnion(const float a, const float b, const float k) {
+  if (k <= 0.f)
+    return fmin(a, b);
+
+  float h = fmax(k - fabs(a - b), 0.f) / k;
+  return fmin(a, b) - h * h * k * 0.25f;
+}
+
+float2 polygonVertex(__global const float4* vertexWords, const uint i) {
+  float4 word = vertexWords[i / 2];
+  return (i & 1) ? word.zw : word.xy;
+}
+
+// Closest edge, sign from the crossings of a horizontal line
+float signedDstToPolygon(const float2 point, __global const float4* vertexWords, const uint count) {
+  float2 first = point - polygonVertex(vertexWords, 0);
+  float dst = dot(first, first);
+  float sign = 1.f;
+
+  for (uint i = 0, j = count - 1; i < count; j = i, i++) {
+    float2 vi = polygonVertex(vertexWords, i);
+    float2 vj = polygonVertex(vertexWords, j);
+    float2 edge = vj - vi;
+    float2 w = point - vi;
+    float2 b = w - edge * clamp(dot(w, edge) / fmax(dot(edge, edge), 1e-12f), 0.f, 1.f);
+    dst = fmin(dst, dot(b, b));
+
+    bool above = point.y >= vi.y;
+    bool below = point.y < vj.y;
+    bool left = edge.x * w.y > edge.y * w.x;
+    if ((above && below && left) || (!above && !below && !left))
+      sign = -sign;
+  }
+
+  return sign * sqrt(dst);
+}
+
+// Interprets the words of one group, same as sdf::ShapeProgram::signedDst
+float signedDstToGroup(const float2 point, __global const float4* program, const ShapeGroup group) {
+  float dst = FLT_MAX;
+
+  for (uint w = group.x; w < group.y;) {
+    float4 header = program[w];
+    uint op = as_uint(header.x);
+    float shapeDst;
+
+    if (op == SHAPE_OP_POLYGON) {
+      uint count = as_uint(header.z);
+      shapeDst = signedDstToPolygon(point, program + w + 1, count);
+      w += 1 + (count + 1) / 2;
+    } else {
+      float4 params = program[w + 1];
+
+      if (op == SHAPE_OP_CIRCLE) {
+        shapeDst = length(point - header.zw) - params.x;
+      } else if (op == SHAPE_OP_BOX) {
+        float2 v = point - header.zw;
+        float2 local = (float2)(v.x * params.z + v.y * params.w, -v.x * params.w + v.y * params.z);
+        shapeDst = signedDstToRectangle(local, (Rectangle)(0.f, 0.f, params.xy));
+      } else {
+        float2 pa = point - header.zw;
+        float2 ba = params.xy - header.zw;
+        float h = clamp(dot(pa, ba) / fmax(dot(ba, ba), 1e-12f), 0.f, 1.f);
+        shapeDst = length(pa - ba * h) - params.z;
+      }
+
+      w += 2;
+    }
+
+    dst = smoothUnion(dst, shapeDst, header.y);
+  }
+
+  return dst;
+}
+#endif
+
+// TILE_SIZE, FULL_SCAN_BIT, RECT_BIT and GROUP_BIT come from the build options (see TileBinning.hpp).
+// Launched with one TILE_SIZE x TILE_SIZE work-group per entry of tiles, so only the listed tiles are evaluated.
+// A group goes through the shapes binned to its tile (tileShapes[tileShapeOffsets[group]..tileShapeOffsets[group + 1]])
+// or through all of them when the tile is marked with FULL_SCAN_BIT.
+// Each group also writes the largest distance of its tile, the host uses it to decide which tiles a moved shape can affect
 __kernel void calcSDF(
   __write_only image2d_t img,
-  __global const Circle* circles, const uint numCircles,
-  __global const Rectangle* rectangles, const uint numRectangles
+  SHAPE_SPACE const Circle* circles, const uint numCircles,
+  SHAPE_SPACE const Rectangle* rectangles, const uint numRectangles,
+  __global const uint* tiles, __global float* tileMaxDst,
+  __global const uint* tileShapeOffsets, __global const uint* tileShapes,
+  __global const float4* program, __global const ShapeGroup* groups, const uint numGroups
 ) {
+  __local float groupMaxDst[TILE_SIZE * TILE_SIZE];
+
   int width = get_image_width(img);
   int height = get_image_height(img);
+  int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
 
-  int x = get_global_id(0);
-  int y = get_global_id(1);
+  uint tileEntry = tiles[get_group_id(0)];
+  uint tile = tileEntry & ~FULL_SCAN_BIT;
+  bool fullScan = tileEntry & FULL_SCAN_BIT;
+  int localIdx = get_local_id(1) * TILE_SIZE + get_local_id(0);
 
-  if (x >= width || y >= height)
-    return;
+  int x = (tile % tilesX) * TILE_SIZE + get_local_id(0);
+  int y = (tile / tilesX) * TILE_SIZE + get_local_id(1);
+
+  bool insideImage = x < width && y < height;
 
   float2 point = (float2)(x, y);
 
@@ -46,20 +148,83 @@ __kernel void calcSDF(
   float maxDst = width;
   // float maxDst = length((float2)(width, height));
 
-  for (int i = 0; i < numCircles; i++) {
-    Circle circle = circles[i];
-    float sdf = signedDstToCircle(point, circle);
-    minDst = fmin(minDst, sdf);
-  }
+  if (insideImage) {
+#ifdef FIXED_SHAPES
+    #pragma unroll
+    for (int i = 0; i < FIXED_CIRCLES; i++)
+      minDst = fmin(minDst, signedDstToCircle(point, circles[i]));
 
-  for (int i = 0; i < numRectangles; i++) {
-    Rectangle rect = rectangles[i];
-    float sdf = signedDstToRectangle(point, rect);
-    minDst = fmin(minDst, sdf);
+    #pragma unroll
+    for (int i = 0; i < FIXED_RECTS; i++)
+      minDst = fmin(minDst, signedDstToRectangle(point, rectangles[i]));
+#else
+    if (fullScan) {
+  #if HAS_CIRCLES
+      for (int i = 0; i < numCircles; i++) {
+        Circle circle = circles[i];
+        float sdf = signedDstToCircle(point, circle);
+        minDst = fmin(minDst, sdf);
+      }
+  #endif
+
+  #if HAS_RECTS
+      for (int i = 0; i < numRectangles; i++) {
+        Rectangle rect = rectangles[i];
+        float sdf = signedDstToRectangle(point, rect);
+        minDst = fmin(minDst, sdf);
+      }
+  #endif
+
+  #if HAS_GROUPS
+      for (uint i = 0; i < numGroups; i++)
+        minDst = fmin(minDst, signedDstToGroup(point, program, groups[i]));
+  #endif
+    } else {
+      // Same list for the whole group, no divergence
+      uint first = tileShapeOffsets[get_group_id(0)];
+      uint last = tileShapeOffsets[get_group_id(0) + 1];
+
+      for (uint i = first; i < last; i++) {
+        uint entry = tileShapes[i];
+  #if HAS_GROUPS
+        if (entry & GROUP_BIT) {
+          minDst = fmin(minDst, signedDstToGroup(point, program, groups[entry & ~GROUP_BIT]));
+          continue;
+        }
+  #endif
+
+  #if HAS_CIRCLES && HAS_RECTS
+        float sdf = (entry & RECT_BIT)
+          ? signedDstToRectangle(point, rectangles[entry & ~RECT_BIT])
+          : signedDstToCircle(point, circles[entry]);
+  #elif HAS_RECTS
+        float sdf = signedDstToRectangle(point, rectangles[entry & ~RECT_BIT]);
+  #elif HAS_CIRCLES
+        float sdf = signedDstToCircle(point, circles[entry]);
+  #else
+        float sdf = FLT_MAX;
+  #endif
+        minDst = fmin(minDst, sdf);
+      }
+    }
+#endif
+
+    float3 col = minDst / maxDst;
+
+    write_imagef(img, (int2)(x, y), (float4)(col, 1.f));
   }
 
-  float3 col = minDst / maxDst;
+  // Every work-item has to reach the barriers, no early return above
+  groupMaxDst[localIdx] = insideImage ? minDst : -FLT_MAX;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (int stride = TILE_SIZE * TILE_SIZE / 2; stride > 0; stride >>= 1) {
+    if (localIdx < stride)
+      groupMaxDst[localIdx] = fmax(groupMaxDst[localIdx], groupMaxDst[localIdx + stride]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
 
-  write_imagef(img, (int2)(x, y), (float4)(col, 1.f));
+  if (localIdx == 0)
+    tileMaxDst[tile] = groupMaxDst[0];
 }
 
@@ -0,0 +1,73 @@
+// Shape tables shared by the host (src/SDF_Shapes.hpp) and the kernels (res/cl/SDF.cl).
+// One float4 of geometry per shape, so a shape is a single aligned 16-byte load. The colors are a
+// separate table indexed the same way, the distance evaluation never touches them
+#ifndef SHAPE_LAYOUT_H
+#define SHAPE_LAYOUT_H
+
+// Shape programs: the primitives beyond the two tables, as a stream of float4 words (see sdf::ShapeProgram).
+// Every instruction starts with a header word, .x = opcode (bits), .y = smooth union radius with what its group
+// evaluated so far (0 = hard union), .zw = first point. Then:
+//   SHAPE_OP_CIRCLE   .zw = center,    next word .x = radius
+//   SHAPE_OP_BOX      .zw = center,    next word .xy = half size, .zw = cos, sin of the rotation
+//   SHAPE_OP_CAPSULE  .zw = first end, next word .xy = second end, .z = radius (0 = line segment)
+//   SHAPE_OP_POLYGON  .z = vertex count (bits), then the vertices two per word (.xy, .zw)
+// A group is a range of words, the scene is the hard union of the groups, circles and rectangles
+#define SHAPE_OP_CIRCLE  0u
+#define SHAPE_OP_BOX     1u
+#define SHAPE_OP_CAPSULE 2u
+#define SHAPE_OP_POLYGON 3u
+
+#ifdef __OPENCL_VERSION__
+
+// .xy = center, .z = radius, .w unused
+typedef float4 Circle;
+
+// .xy = center, .zw = half size
+typedef float4 Rectangle;
+
+// .xyz = color, .w unused
+typedef float4 ShapeColor;
+
+// .x = first word, .y = end word
+typedef uint2 ShapeGroup;
+
+#else
+
+#include <cstddef>
+
+#include "CL/cl.h"
+
+namespace sdf {
+
+struct alignas(16) Circle {
+  cl_float2 center;
+  cl_float radius;
+  cl_float unused = 0.f;
+};
+
+struct alignas(16) Rectangle {
+  cl_float2 center;
+  cl_float2 sizeFromCenter;
+};
+
+using ShapeColor = cl_float4;
+
+struct ShapeGroup {
+  cl_uint first;
+  cl_uint end;
+};
+
+// Read as float4 by the kernels
+static_assert(sizeof(Circle) == sizeof(cl_float4) && alignof(Circle) == 16);
+static_assert(offsetof(Circle, center) == 0 && offsetof(Circle, radius) == 8);
+static_assert(sizeof(Rectangle) == sizeof(cl_float4) && alignof(Rectangle) == 16);
+static_assert(offsetof(Rectangle, center) == 0 && offsetof(Rectangle, sizeFromCenter) == 8);
+static_assert(sizeof(ShapeColor) == 16);
+static_assert(sizeof(ShapeGroup) == sizeof(cl_uint2) && offsetof(ShapeGroup, end) == 4);
+
+} // namespace sdf
+
+#endif
+
+#endif
+
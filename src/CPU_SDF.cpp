@@ -0,0 +1,188 @@
+#include "CPU_SDF.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX__)
+  #include <immintrin.h>
+#elif defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+// ===== SIMD wrappers =================================================== //
+
+namespace {
+
+#if defined(__AVX__)
+
+using vfloat = __m256;
+constexpr size_t LANES = 8;
+
+inline vfloat vset(float v)              { return _mm256_set1_ps(v); }
+inline vfloat vadd(vfloat a, vfloat b)   { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b)   { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b)   { return _mm256_mul_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b)   { return _mm256_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b)   { return _mm256_max_ps(a, b); }
+inline vfloat vsqrt(vfloat a)            { return _mm256_sqrt_ps(a); }
+inline vfloat vabs(vfloat a)             { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+inline vfloat vramp(float first)         { return _mm256_add_ps(_mm256_set1_ps(first), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)); }
+inline void   vstore(float* dst, vfloat a) { _mm256_storeu_ps(dst, a); }
+inline vfloat vload(const float* src)    { return _mm256_loadu_ps(src); }
+
+#elif defined(__SSE2__)
+
+using vfloat = __m128;
+constexpr size_t LANES = 4;
+
+inline vfloat vset(float v)              { return _mm_set1_ps(v); }
+inline vfloat vadd(vfloat a, vfloat b)   { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b)   { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b)   { return _mm_mul_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b)   { return _mm_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b)   { return _mm_max_ps(a, b); }
+inline vfloat vsqrt(vfloat a)            { return _mm_sqrt_ps(a); }
+inline vfloat vabs(vfloat a)             { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+inline vfloat vramp(float first)         { return _mm_add_ps(_mm_set1_ps(first), _mm_setr_ps(0, 1, 2, 3)); }
+inline void   vstore(float* dst, vfloat a) { _mm_storeu_ps(dst, a); }
+inline vfloat vload(const float* src)    { return _mm_loadu_ps(src); }
+
+#else
+
+using vfloat = float;
+constexpr size_t LANES = 1;
+
+inline vfloat vset(float v)              { return v; }
+inline vfloat vadd(vfloat a, vfloat b)   { return a + b; }
+inline vfloat vsub(vfloat a, vfloat b)   { return a - b; }
+inline vfloat vmul(vfloat a, vfloat b)   { return a * b; }
+inline vfloat vmin(vfloat a, vfloat b)   { return std::min(a, b); }
+inline vfloat vmax(vfloat a, vfloat b)   { return std::max(a, b); }
+inline vfloat vsqrt(vfloat a)            { return std::sqrt(a); }
+inline vfloat vabs(vfloat a)             { return std::fabs(a); }
+inline vfloat vramp(float first)         { return first; }
+inline void   vstore(float* dst, vfloat a) { *dst = a; }
+inline vfloat vload(const float* src)    { return *src; }
+
+#endif
+
+// signedDstToCircle from SDF.cl. The shape's float4 is broadcast to all the lanes
+inline vfloat signedDstToCircle(vfloat px, vfloat py, const sdf::Circle& circle) {
+  vfloat dx = vsub(px, vset(circle.center.x));
+  vfloat dy = vsub(py, vset(circle.center.y));
+  return vsub(vsqrt(vadd(vmul(dx, dx), vmul(dy, dy))), vset(circle.radius));
+}
+
+// signedDstToRectangle from SDF.cl
+inline vfloat signedDstToRectangle(vfloat px, vfloat py, const sdf::Rectangle& rect) {
+  vfloat offsetX = vsub(vabs(vsub(px, vset(rect.center.x))), vset(rect.sizeFromCenter.x));
+  vfloat offsetY = vsub(vabs(vsub(py, vset(rect.center.y))), vset(rect.sizeFromCenter.y));
+
+  vfloat outsideX = vmax(offsetX, vset(0.f));
+  vfloat outsideY = vmax(offsetY, vset(0.f));
+  vfloat unsignedDst = vsqrt(vadd(vmul(outsideX, outsideX), vmul(outsideY, outsideY)));
+
+  vfloat dstInsideBox = vmin(vmax(offsetX, offsetY), vset(0.f));
+
+  return vadd(unsignedDst, dstInsideBox);
+}
+
+// signedDstToGroup from SDF.cl, the lanes one by one: the instructions differ per group
+inline vfloat signedDstToGroup(float x, float y, const sdf::ShapeProgram& program, size_t group) {
+  float dst[LANES];
+  for (size_t l = 0; l < LANES; l++)
+    dst[l] = program.signedDst({x + l, y}, group);
+  return vload(dst);
+}
+
+} // namespace
+
+// ======================================================================= //
+
+CPU_SDF::CPU_SDF(size_t width, size_t height, sdf::Format format, size_t threadCount)
+  : SDF_Backend(width, height, format), threadPool(threadCount) {}
+
+// Evaluated straight from the shared geometry tables, nothing to copy
+void CPU_SDF::updateCirclesBuffer(size_t, size_t) {}
+void CPU_SDF::updateRectsBuffer(size_t, size_t)   {}
+
+void CPU_SDF::compute() {
+  threadPool.parallelFor(binning.getTiles().size(), [this](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      calcTile(i);
+  });
+}
+
+const char* CPU_SDF::getName() const {
+  return "CPU";
+}
+
+size_t CPU_SDF::getLaneCount() {
+  return LANES;
+}
+
+void CPU_SDF::calcTile(size_t i) {
+  const float maxDst = static_cast<float>(width);
+  const size_t numCircles = circles.size();
+  const size_t numRects = rects.size();
+  const size_t numGroups = program.getGroupCount();
+
+  const u32 tile = binning.getTiles()[i] & ~TileBinning::FULL_SCAN_BIT;
+  const bool fullScan = binning.getTiles()[i] & TileBinning::FULL_SCAN_BIT;
+  const u32* entries = binning.getEntries().data();
+  const u32 firstEntry = binning.getOffsets()[i];
+  const u32 lastEntry = binning.getOffsets()[i + 1];
+
+  const size_t x0 = (tile % tilesX) * TILE_SIZE;
+  const size_t y0 = (tile / tilesX) * TILE_SIZE;
+  const size_t x1 = std::min(x0 + TILE_SIZE, width);
+  const size_t y1 = std::min(y0 + TILE_SIZE, height);
+
+  alignas(32) float dst[LANES];
+  float tileMax = -FLT_MAX;
+
+  for (size_t y = y0; y < y1; y++) {
+    const vfloat py = vset(static_cast<float>(y));
+
+    for (size_t x = x0; x < x1; x += LANES) {
+      const vfloat px = vramp(static_cast<float>(x));
+      vfloat minDst = vset(FLT_MAX);
+
+      if (fullScan) {
+        for (size_t j = 0; j < numCircles; j++)
+          minDst = vmin(minDst, signedDstToCircle(px, py, circles[j]));
+
+        for (size_t j = 0; j < numRects; j++)
+          minDst = vmin(minDst, signedDstToRectangle(px, py, rects[j]));
+
+        for (size_t j = 0; j < numGroups; j++)
+          minDst = vmin(minDst, signedDstToGroup(x, y, program, j));
+      } else {
+        for (u32 e = firstEntry; e < lastEntry; e++) {
+          const u32 j = entries[e] & ~(TileBinning::RECT_BIT | TileBinning::GROUP_BIT);
+
+          if (entries[e] & TileBinning::GROUP_BIT)
+            minDst = vmin(minDst, signedDstToGroup(x, y, program, j));
+          else if (entries[e] & TileBinning::RECT_BIT)
+            minDst = vmin(minDst, signedDstToRectangle(px, py, rects[j]));
+          else
+            minDst = vmin(minDst, signedDstToCircle(px, py, circles[j]));
+        }
+      }
+
+      vstore(dst, minDst);
+
+      const size_t lanes = std::min(LANES, x1 - x);
+
+      for (size_t l = 0; l < lanes; l++) {
+        sdf::store(format, pixels, y * width + x + l, dst[l] / maxDst);
+
+        tileMax = std::max(tileMax, dst[l]);
+      }
+    }
+  }
+
+  tileMaxDst[tile] = tileMax;
+}
+
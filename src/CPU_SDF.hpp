@@ -0,0 +1,30 @@
+#pragma once
+
+#include "SDF_Backend.hpp"
+#include "ThreadPool.hpp"
+
+// Native fallback for machines without an OpenCL GPU.
+// Evaluates the same distance functions as res/cl/SDF.cl, several pixels of a row at once, tiles spread over a thread pool
+class CPU_SDF : public SDF_Backend {
+public:
+  CPU_SDF(size_t width, size_t height, sdf::Format format = sdf::Format::RGBA8, size_t threadCount = 0);
+
+  [[nodiscard]]
+  const char* getName() const override;
+
+  [[nodiscard]]
+  static size_t getLaneCount();
+
+private:
+  ThreadPool threadPool;
+
+private:
+  void updateCirclesBuffer(size_t begin, size_t end) override;
+  void updateRectsBuffer(size_t begin, size_t end) override;
+
+  void compute() override;
+
+  // i = position in binning.getTiles()
+  void calcTile(size_t i);
+};
+
@@ -0,0 +1,224 @@
+#include "JFA_SDF.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+
+JFA_SDF::JFA_SDF(size_t width, size_t height, bool useOpenCL, sdf::Format format, bool printInfo)
+  : SDF_Backend(width, height, format), steps(calcSteps(width, height)), threadPool(useOpenCL ? 1 : 0) {
+
+  // Seeds are packed as y << 16 | x
+  assert(width <= 0xFFFF && height <= 0x7FFF);
+
+  // Every run covers the whole image anyway
+  setBinning(false);
+
+  if (!useOpenCL) {
+    seeds.assign(imageSize, 0);
+    nearest[0].resize(imageSize);
+    nearest[1].resize(imageSize);
+    return;
+  }
+
+  ocl = std::make_unique<OCL_Context>(printInfo);
+
+  cl_int gpuMallocResult;
+  gpuScene = clCreateBuffer(ocl->context, CL_MEM_READ_ONLY, imageSize * 4, nullptr, &gpuMallocResult);
+  assert(gpuMallocResult == CL_SUCCESS);
+
+  for (cl_mem& buffer : gpuNearest) {
+    buffer = clCreateBuffer(ocl->context, CL_MEM_READ_WRITE, sizeof(cl_int) * imageSize, nullptr, &gpuMallocResult);
+    assert(gpuMallocResult == CL_SUCCESS);
+  }
+
+  const cl_image_format imageFormat = sdf::clImageFormat(format);
+  cl_image_desc imageDesc = {};
+  imageDesc.image_type = CL_MEM_OBJECT_IMAGE2D;
+  imageDesc.image_width = width;
+  imageDesc.image_height = height;
+  gpuImage = clCreateImage(ocl->context, CL_MEM_WRITE_ONLY, &imageFormat, &imageDesc, nullptr, &gpuMallocResult);
+  assert(gpuMallocResult == CL_SUCCESS);
+
+  // Nothing drawn yet
+  [[maybe_unused]]
+  cl_int errCode;
+  const cl_uchar zero = 0;
+  errCode = clEnqueueFillBuffer(ocl->commandQueue, gpuScene, &zero, sizeof(zero), 0, imageSize * 4, 0, nullptr, nullptr);
+  assert(errCode == CL_SUCCESS);
+
+  program = ocl->buildProgram("res/cl/JFA.cl");
+  initKernel = ocl->createKernel(program, "jfaInit");
+  stepKernel = ocl->createKernel(program, "jfaStep");
+  distanceKernel = ocl->createKernel(program, "jfaDistance");
+
+  const float maxDst = static_cast<float>(width);
+  errCode = clSetKernelArg(initKernel, 0, sizeof(cl_mem), &gpuScene);         assert(errCode == CL_SUCCESS);
+  errCode = clSetKernelArg(initKernel, 1, sizeof(cl_mem), &gpuNearest[0]);    assert(errCode == CL_SUCCESS);
+  errCode = clSetKernelArg(distanceKernel, 1, sizeof(cl_mem), &gpuImage);     assert(errCode == CL_SUCCESS);
+  errCode = clSetKernelArg(distanceKernel, 2, sizeof(cl_float), &maxDst);     assert(errCode == CL_SUCCESS);
+}
+
+JFA_SDF::~JFA_SDF() {
+  if (!ocl)
+    return;
+
+  clReleaseMemObject(gpuScene);
+  clReleaseMemObject(gpuNearest[0]);
+  clReleaseMemObject(gpuNearest[1]);
+  clReleaseMemObject(gpuImage);
+
+	clReleaseKernel(initKernel);
+	clReleaseKernel(stepKernel);
+	clReleaseKernel(distanceKernel);
+	clReleaseProgram(program);
+}
+
+const char* JFA_SDF::getName() const {
+  return ocl ? "JumpFlood (OpenCL)" : "JumpFlood (CPU)";
+}
+
+bool JFA_SDF::usesSeeds() const {
+  return true;
+}
+
+void JFA_SDF::updateSeeds(const sf::Image& scene) {
+  assert(scene.getSize().x == width && scene.getSize().y == height);
+  const u8* scenePixels = scene.getPixelsPtr();
+
+  if (ocl) {
+    [[maybe_unused]]
+    cl_int hostCopyResult = clEnqueueWriteBuffer(ocl->commandQueue, gpuScene, CL_TRUE, 0, imageSize * 4, scenePixels, 0, nullptr, nullptr);
+    assert(hostCopyResult == CL_SUCCESS);
+  } else {
+    for (size_t i = 0; i < imageSize; i++)
+      seeds[i] = scenePixels[i * 4 + 3] > 0;
+  }
+
+  invalidate();
+}
+
+// The shapes only matter through the rendered scene, any change means a full pass
+void JFA_SDF::updateCirclesBuffer(size_t, size_t) { invalidate(); }
+void JFA_SDF::updateRectsBuffer(size_t, size_t)   { invalidate(); }
+void JFA_SDF::updateProgramBuffer()               { invalidate(); }
+
+void JFA_SDF::compute() {
+  if (ocl)
+    computeOCL();
+  else
+    computeCPU();
+}
+
+void JFA_SDF::computeCPU() {
+  const int w = static_cast<int>(width);
+  const int h = static_cast<int>(height);
+
+  auto dstSquared = [](int x, int y, cl_int seed) {
+    int dx = (seed & 0xFFFF) - x;
+    int dy = (seed >> 16) - y;
+    return dx * dx + dy * dy;
+  };
+
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+      nearest[0][y * w + x] = seeds[y * w + x] ? (y << 16 | x) : -1;
+
+  int src = 0;
+  for (int step : steps) {
+    const cl_int* in = nearest[src].data();
+    cl_int* out = nearest[src ^ 1].data();
+
+    threadPool.parallelFor(height, [&](size_t begin, size_t end) {
+      for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++) {
+        for (int x = 0; x < w; x++) {
+          cl_int best = in[y * w + x];
+          int bestDst = best < 0 ? INT_MAX : dstSquared(x, y, best);
+
+          for (int dy = -step; dy <= step; dy += step) {
+            for (int dx = -step; dx <= step; dx += step) {
+              int nx = x + dx;
+              int ny = y + dy;
+              if ((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= w || ny >= h)
+                continue;
+
+              cl_int seed = in[ny * w + nx];
+              if (seed < 0)
+                continue;
+
+              int seedDst = dstSquared(x, y, seed);
+              if (seedDst < bestDst) {
+                best = seed;
+                bestDst = seedDst;
+              }
+            }
+          }
+
+          out[y * w + x] = best;
+        }
+      }
+    });
+
+    src ^= 1;
+  }
+
+  // Same encoding as calcSDF in res/cl/SDF.cl
+  const float maxDst = static_cast<float>(width);
+  const cl_int* result = nearest[src].data();
+
+  threadPool.parallelFor(height, [&](size_t begin, size_t end) {
+    for (int y = static_cast<int>(begin); y < static_cast<int>(end); y++) {
+      for (int x = 0; x < w; x++) {
+        cl_int seed = result[y * w + x];
+
+        // The edge lies between the seed and its outside neighbour, half a pixel off on average
+        float dst = seed < 0 ? maxDst : std::max(std::sqrt(static_cast<float>(dstSquared(x, y, seed))) - 0.5f, 0.f);
+        sdf::store(format, pixels, y * width + x, dst / maxDst);
+      }
+    }
+  });
+}
+
+void JFA_SDF::computeOCL() {
+  const size_t globalWorkSize[2] = {width, height};
+
+  [[maybe_unused]]
+  cl_int errCode;
+
+  errCode = clEnqueueNDRangeKernel(ocl->commandQueue, initKernel, 2, nullptr, globalWorkSize, nullptr, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+
+  int src = 0;
+  for (cl_int step : steps) {
+    errCode = clSetKernelArg(stepKernel, 0, sizeof(cl_mem), &gpuNearest[src]);     assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(stepKernel, 1, sizeof(cl_mem), &gpuNearest[src ^ 1]); assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(stepKernel, 2, sizeof(cl_int), &step);                assert(errCode == CL_SUCCESS);
+    errCode = clEnqueueNDRangeKernel(ocl->commandQueue, stepKernel, 2, nullptr, globalWorkSize, nullptr, 0, nullptr, nullptr);
+    assert(errCode == CL_SUCCESS);
+
+    src ^= 1;
+  }
+
+  errCode = clSetKernelArg(distanceKernel, 0, sizeof(cl_mem), &gpuNearest[src]); assert(errCode == CL_SUCCESS);
+  errCode = clEnqueueNDRangeKernel(ocl->commandQueue, distanceKernel, 2, nullptr, globalWorkSize, nullptr, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+
+  const size_t origin[3] = {0, 0, 0};
+  const size_t region[3] = {width, height, 1};
+  errCode = clEnqueueReadImage(ocl->commandQueue, gpuImage, CL_TRUE, origin, region, width * sdf::pixelSize(format), 0, pixels, 0, nullptr, nullptr);
+  assert(errCode == CL_SUCCESS);
+}
+
+std::vector<cl_int> JFA_SDF::calcSteps(size_t width, size_t height) {
+  cl_int step = 1;
+  while (static_cast<size_t>(step) * 2 < std::max(width, height))
+    step *= 2;
+
+  std::vector<cl_int> steps;
+  for (; step > 0; step /= 2)
+    steps.push_back(step);
+
+  // One more pass of 1 fixes most of the misses of the plain algorithm
+  steps.push_back(1);
+
+  return steps;
+}
+
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+
+#include "OCL_Context.hpp"
+#include "SDF_Backend.hpp"
+#include "ThreadPool.hpp"
+
+// Jump Flooding over the rendered scene instead of the shape list, so any drawable works as an obstacle
+// and the cost doesn't depend on the number of shapes: log2(max(width, height)) + 1 passes over the image.
+// Runs as OpenCL kernels (res/cl/JFA.cl) when a GPU is present, on the thread pool otherwise.
+//
+// The distance is measured between pixel centers (error up to about a pixel) and is 0 inside the shapes.
+// Any change of the scene needs a full pass, the tiles aren't used
+class JFA_SDF : public SDF_Backend {
+public:
+  JFA_SDF(size_t width, size_t height, bool useOpenCL, sdf::Format format = sdf::Format::RGBA8, bool printInfo = false);
+  ~JFA_SDF();
+
+  [[nodiscard]]
+  const char* getName() const override;
+
+  [[nodiscard]]
+  bool usesSeeds() const override;
+
+  // Pixels with alpha > 0 are the seeds
+  void updateSeeds(const sf::Image& scene) override;
+
+private:
+  // Jump of every pass
+  const std::vector<cl_int> steps;
+
+  // alpha > 0 of the last scene
+  std::vector<u8> seeds;
+
+  // Closest seed of every pixel (y << 16 | x, -1 = none yet), ping-ponged between the passes
+  std::vector<cl_int> nearest[2];
+  ThreadPool threadPool;
+
+  std::unique_ptr<OCL_Context> ocl;
+  cl_mem gpuScene = nullptr;
+  cl_mem gpuNearest[2] = {nullptr, nullptr};
+  cl_mem gpuImage = nullptr;
+
+  cl_program program = nullptr;
+  cl_kernel initKernel = nullptr;
+  cl_kernel stepKernel = nullptr;
+  cl_kernel distanceKernel = nullptr;
+
+private:
+  void updateCirclesBuffer(size_t begin, size_t end) override;
+  void updateRectsBuffer(size_t begin, size_t end) override;
+  void updateProgramBuffer() override;
+
+  void compute() override;
+
+  void computeCPU();
+  void computeOCL();
+
+  // Largest power of two below max(width, height), halved down to 1
+  [[nodiscard]]
+  static std::vector<cl_int> calcSteps(size_t width, size_t height);
+};
+
@@ -0,0 +1,425 @@
+#include "MultiOCL_SDF.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include "OCL_SDF.hpp"
+
+// The command has to be done
+// Recreated when the count changed, then the changed range written without waiting (see waitIdle)
+static void writeTable(cl_context context, cl_command_queue queue, cl_mem& buffer, bool recreate, const void* data, size_t elementSize, size_t count, size_t begin, size_t end) {
+  [[maybe_unused]]
+  cl_int errCode;
+
+  if (recreate) {
+    if (buffer) clReleaseMemObject(buffer);
+    buffer = nullptr;
+
+    if (count > 0) {
+      buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, elementSize * count, nullptr, &errCode);
+      assert(errCode == CL_SUCCESS);
+    }
+  }
+
+  if (begin == end)
+    return;
+
+  const u8* bytes = static_cast<const u8*>(data);
+  errCode = clEnqueueWriteBuffer(queue, buffer, CL_FALSE, elementSize * begin, elementSize * (end - begin), bytes + elementSize * begin, 0, nullptr, nullptr);
+  assert(errCode == CL_SUCCESS);
+}
+
+MultiOCL_SDF::MultiOCL_SDF(size_t width, size_t height, sdf::Format format, bool printInfo)
+  : MultiOCL_SDF(width, height, OCL_Context::findDevices(), format, printInfo) {}
+
+MultiOCL_SDF::MultiOCL_SDF(size_t width, size_t height, std::vector<cl_device_id> ids, sdf::Format format, bool printInfo)
+  : SDF_Backend(width, height, format) {
+
+  assert(!ids.empty());
+
+  // A band is a tile row at least
+  ids.resize(std::min(ids.size(), tilesY));
+
+  const cl_image_format imageFormat = sdf::clImageFormat(format);
+  const std::string buildOptions = OCL_SDF::getBaseBuildOptions();
+
+  for (cl_device_id id : ids) {
+    Device& device = *devices.emplace_back(std::make_unique<Device>(id, printInfo));
+    cl_context context = device.ocl.context;
+
+    // Written by the kernel, and from pixels for the rows its band gains
+    cl_int mallocResult;
+    cl_image_desc imageDesc;
+    memset(&imageDesc, 0, sizeof(imageDesc));
+    imageDesc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    imageDesc.image_width = width;
+    imageDesc.image_height = height;
+    device.image = clCreateImage(context, CL_MEM_WRITE_ONLY, &imageFormat, &imageDesc, nullptr, &mallocResult);
+    assert(mallocResult == CL_SUCCESS);
+
+    device.tiles = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * getTileCount(), nullptr, &mallocResult);
+    assert(mallocResult == CL_SUCCESS);
+
+    device.tileMaxDst = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_float) * getTileCount(), nullptr, &mallocResult);
+    assert(mallocResult == CL_SUCCESS);
+
+    device.tileShapeOffsets = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(cl_uint) * (getTileCount() + 1), nullptr, &mallocResult);
+    assert(mallocResult == CL_SUCCESS);
+
+    device.hostTileMaxDst.resize(getTileCount());
+
+    // Only the generic kernel, the devices share the scene and so would the variants
+    device.program = device.ocl.buildProgram("res/cl/SDF.cl", buildOptions);
+    device.kernel = device.ocl.createKernel(device.program, "calcSDF");
+  }
+
+  tileWork.assign(getTileCount(), 0.);
+
+  // Even bands until the first runs are measured
+  for (size_t d = 0; d < devices.size(); d++) {
+    devices[d]->firstRow = tilesY * d / devices.size();
+    devices[d]->endRow = tilesY * (d + 1) / devices.size();
+  }
+
+  assignRows();
+}
+
+MultiOCL_SDF::~MultiOCL_SDF() {
+  waitIdle();
+
+  for (auto& device : devices) {
+    if (device->kernelDone) clReleaseEvent(device->kernelDone);
+    if (device->readDone) clReleaseEvent(device->readDone);
+
+    for (cl_mem buffer : {
+      device->image, device->circles, device->rects, device->programWords, device->groups,
+      device->tiles, device->tileMaxDst, device->tileShapeOffsets, device->tileShapes
+    }) {
+      if (buffer) clReleaseMemObject(buffer);
+    }
+
+    clReleaseKernel(device->kernel);
+    clReleaseProgram(device->program);
+  }
+}
+
+void MultiOCL_SDF::updateCirclesBuffer(size_t begin, size_t end) {
+  const bool resized = circles.size() != numCircles;
+  numCircles = static_cast<cl_uint>(circles.size());
+
+  for (auto& device : devices)
+    writeTable(device->ocl.context, device->ocl.commandQueue, device->circles, resized, circles.data(), sizeof(Circle), numCircles, begin, end);
+}
+
+void MultiOCL_SDF::updateRectsBuffer(size_t begin, size_t end) {
+  const bool resized = rects.size() != numRects;
+  numRects = static_cast<cl_uint>(rects.size());
+
+  for (auto& device : devices)
+    writeTable(device->ocl.context, device->ocl.commandQueue, device->rects, resized, rects.data(), sizeof(Rectangle), numRects, begin, end);
+}
+
+void MultiOCL_SDF::updateProgramBuffer() {
+  numGroups = static_cast<cl_uint>(program.getGroupCount());
+
+  const std::vector<cl_float4>& words = program.getWords();
+  const std::vector<sdf::ShapeGroup>& groups = program.getGroups();
+
+  for (auto& device : devices) {
+    if (device->programWords) clReleaseMemObject(device->programWords);
+    if (device->groups) clReleaseMemObject(device->groups);
+    device->programWords = nullptr;
+    device->groups = nullptr;
+
+    if (numGroups == 0)
+      continue;
+
+    // Copied at creation, the host copy may change right after
+    cl_int mallocResult;
+    device->programWords = clCreateBuffer(device->ocl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_float4) * words.size(), const_cast<cl_float4*>(words.data()), &mallocResult);
+    assert(mallocResult == CL_SUCCESS);
+
+    device->groups = clCreateBuffer(device->ocl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(sdf::ShapeGroup) * groups.size(), const_cast<sdf::ShapeGroup*>(groups.data()), &mallocResult);
+    assert(mallocResult == CL_SUCCESS);
+  }
+}
+
+void MultiOCL_SDF::compute() {
+  const std::vector<u32>& tiles = binning.getTiles();
+  const std::vector<u32>& tileShapeOffsets = binning.getOffsets();
+  const std::vector<u32>& tileShapes = binning.getEntries();
+
+  // A full run rewrites every band anyway
+  const bool fullRun = tiles.size() == getTileCount();
+
+  for (auto& device : devices) {
+    if (!fullRun)
+      uploadGainedRows(*device);
+
+    device->runTiles.clear();
+    device->runShapes.clear();
+    device->runOffsets.assign(1, 0);
+    device->runWork = 0.;
+  }
+
+  // Each tile to the device owning its row, with its shapes
+  const double sceneShapes = static_cast<double>(numCircles) + numRects + numGroups;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    u32 tile = tiles[i] & ~TileBinning::FULL_SCAN_BIT;
+    Device& device = *devices[rowOwners[tile / tilesX]];
+
+    device.runTiles.push_back(tiles[i]);
+    device.runShapes.insert(device.runShapes.end(), tileShapes.begin() + tileShapeOffsets[i], tileShapes.begin() + tileShapeOffsets[i + 1]);
+    device.runOffsets.push_back(static_cast<u32>(device.runShapes.size()));
+
+    // The kernel's cost is the shapes each pixel goes through, the +1 stands for the write and the empty tiles
+    double shapes = tiles[i] & TileBinning::FULL_SCAN_BIT ? sceneShapes : tileShapeOffsets[i + 1] - tileShapeOffsets[i];
+    tileWork[tile] = (shapes + 1.) * TILE_SIZE * TILE_SIZE;
+    device.runWork += tileWork[tile];
+  }
+
+  [[maybe_unused]]
+  cl_int errCode;
+
+  constexpr size_t localWorkSize[2] = {TILE_SIZE, TILE_SIZE};
+  const size_t pixelBytes = sdf::pixelSize(format);
+  const size_t rowPitch = width * pixelBytes;
+
+  for (auto& devicePtr : devices) {
+    Device& device = *devicePtr;
+    if (device.runTiles.empty())
+      continue;
+
+    cl_command_queue queue = device.ocl.commandQueue;
+
+    if (device.runShapes.size() > device.tileShapesCapacity) {
+      if (device.tileShapes) clReleaseMemObject(device.tileShapes);
+      device.tileShapesCapacity = std::max(device.runShapes.size(), device.tileShapesCapacity * 2);
+      device.tileShapes = clCreateBuffer(device.ocl.context, CL_MEM_READ_ONLY, sizeof(cl_uint) * device.tileShapesCapacity, nullptr, &errCode);
+      assert(errCode == CL_SUCCESS);
+    }
+
+    cl_kernel kernel = device.kernel;
+    errCode = clSetKernelArg(kernel, 0, sizeof(cl_mem), &device.image); assert(errCode == CL_SUCCESS);
+
+    errCode = clSetKernelArg(kernel, 1, sizeof(cl_mem), &device.circles); assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 2, sizeof(cl_uint), &numCircles);    assert(errCode == CL_SUCCESS);
+
+    errCode = clSetKernelArg(kernel, 3, sizeof(cl_mem), &device.rects); assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 4, sizeof(cl_uint), &numRects);    assert(errCode == CL_SUCCESS);
+
+    errCode = clSetKernelArg(kernel, 5, sizeof(cl_mem), &device.tiles);            assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 6, sizeof(cl_mem), &device.tileMaxDst);       assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 7, sizeof(cl_mem), &device.tileShapeOffsets); assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 8, sizeof(cl_mem), &device.tileShapes);       assert(errCode == CL_SUCCESS);
+
+    errCode = clSetKernelArg(kernel, 9, sizeof(cl_mem), &device.programWords); assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 10, sizeof(cl_mem), &device.groups);      assert(errCode == CL_SUCCESS);
+    errCode = clSetKernelArg(kernel, 11, sizeof(cl_uint), &numGroups);         assert(errCode == CL_SUCCESS);
+
+    errCode = clEnqueueWriteBuffer(queue, device.tiles, CL_FALSE, 0, sizeof(cl_uint) * device.runTiles.size(), device.runTiles.data(), 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+    errCode = clEnqueueWriteBuffer(queue, device.tileShapeOffsets, CL_FALSE, 0, sizeof(cl_uint) * device.runOffsets.size(), device.runOffsets.data(), 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+    if (!device.runShapes.empty()) {
+      errCode = clEnqueueWriteBuffer(queue, device.tileShapes, CL_FALSE, 0, sizeof(cl_uint) * device.runShapes.size(), device.runShapes.data(), 0, nullptr, nullptr);
+      assert(errCode == CL_SUCCESS);
+    }
+
+    // One work-group per tile of its own list
+    const size_t globalWorkSize[2] = {device.runTiles.size() * TILE_SIZE, TILE_SIZE};
+    errCode = clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, globalWorkSize, localWorkSize, 0, nullptr, &device.kernelDone);
+    assert(errCode == CL_SUCCESS);
+    device.kernelQueuedAt = std::chrono::steady_clock::now();
+
+    errCode = clEnqueueReadBuffer(queue, device.tileMaxDst, CL_FALSE, 0, sizeof(cl_float) * getTileCount(), device.hostTileMaxDst.data(), 0, nullptr, nullptr);
+    assert(errCode == CL_SUCCESS);
+
+    // The bounding box of its tiles stays inside its band, the devices read disjoint rows of pixels
+    size_t minX = tilesX, minY = tilesY, maxX = 0, maxY = 0;
+    for (u32 tileEntry : device.runTiles) {
+      u32 tile = tileEntry & ~TileBinning::FULL_SCAN_BIT;
+      minX = std::min<size_t>(minX, tile % tilesX);
+      minY = std::min<size_t>(minY, tile / tilesX);
+      maxX = std::max<size_t>(maxX, tile % tilesX);
+      maxY = std::max<size_t>(maxY, tile / tilesX);
+    }
+
+    const size_t origin[3] = {minX * TILE_SIZE, minY * TILE_SIZE, 0};
+    const size_t region[3] = {
+      std::min((maxX + 1) * TILE_SIZE, width) - origin[0],
+      std::min((maxY + 1) * TILE_SIZE, height) - origin[1],
+      1
+    };
+    u8* regionPixels = pixels + origin[1] * rowPitch + origin[0] * pixelBytes;
+    errCode = clEnqueueReadImage(queue, device.image, CL_FALSE, origin, region, rowPitch, 0, regionPixels, 0, nullptr, &device.readDone);
+    assert(errCode == CL_SUCCESS);
+    device.readQueuedAt = std::chrono::steady_clock::now();
+
+    // Submitted now so the devices run side by side
+    errCode = clFlush(queue); assert(errCode == CL_SUCCESS);
+  }
+
+  // The slowest device is the one the frame waits for
+  OCL_Context::CommandTime slowestKernel, slowestRead;
+
+  for (auto& devicePtr : devices) {
+    Device& device = *devicePtr;
+    errCode = clFinish(device.ocl.commandQueue); assert(errCode == CL_SUCCESS);
+
+    device.heldFirstRow = device.firstRow;
+    device.heldEndRow = device.endRow;
+    device.kernelMs = 0.;
+    device.readMs = 0.;
+
+    if (!device.kernelDone)
+      continue;
+
+    for (u32 tileEntry : device.runTiles) {
+      u32 tile = tileEntry & ~TileBinning::FULL_SCAN_BIT;
+      tileMaxDst[tile] = device.hostTileMaxDst[tile];
+    }
+
+    OCL_Context::CommandTime kernelTime = OCL_Context::commandTime(device.kernelDone, device.kernelQueuedAt);
+    OCL_Context::CommandTime readTime = OCL_Context::commandTime(device.readDone, device.readQueuedAt);
+    device.kernelMs = kernelTime.ms;
+    device.readMs = readTime.ms;
+    clReleaseEvent(device.kernelDone);
+    clReleaseEvent(device.readDone);
+    device.kernelDone = nullptr;
+    device.readDone = nullptr;
+
+    // A few tiles tell more about the launch overhead than about the device
+    if (device.runTiles.size() >= tilesX && device.kernelMs > 0.) {
+      double workPerMs = device.runWork / device.kernelMs;
+      device.workPerMs = device.workPerMs > 0. ? std::lerp(device.workPerMs, workPerMs, SPEED_SMOOTHING) : workPerMs;
+    }
+
+    if (kernelTime.ms > slowestKernel.ms) slowestKernel = kernelTime;
+    if (readTime.ms > slowestRead.ms)     slowestRead = readTime;
+  }
+
+  lastTimes = {slowestKernel.ms, slowestRead.ms, slowestKernel.start, slowestRead.start};
+
+  rebalance();
+}
+
+void MultiOCL_SDF::rebalance() {
+  // Not before every device has been measured
+  double totalSpeed = 0.;
+  for (auto& device : devices) {
+    if (device->workPerMs <= 0.)
+      return;
+    totalSpeed += device->workPerMs;
+  }
+
+  std::vector<double> rowWork(tilesY, 0.);
+  for (size_t tile = 0; tile < tileWork.size(); tile++)
+    rowWork[tile / tilesX] += tileWork[tile];
+
+  const double totalWork = std::accumulate(rowWork.begin(), rowWork.end(), 0.);
+  if (totalWork <= 0.)
+    return;
+
+  // Each band ends where the work so far reaches the share of the devices so far
+  double speedSoFar = 0.;
+  double workSoFar = 0.;
+  size_t row = 0;
+
+  for (size_t d = 0; d < devices.size(); d++) {
+    Device& device = *devices[d];
+    speedSoFar += device.workPerMs;
+
+    // Rows left for every device after this one
+    const size_t rowsAfter = devices.size() - d - 1;
+    const double target = totalWork * speedSoFar / totalSpeed;
+
+    device.firstRow = row;
+    do {
+      workSoFar += rowWork[row++];
+    } while (row < tilesY - rowsAfter && (rowsAfter == 0 || workSoFar + 0.5 * rowWork[row] < target));
+
+    device.endRow = row;
+  }
+
+  assignRows();
+}
+
+void MultiOCL_SDF::setBands(const std::vector<size_t>& endRows) {
+  assert(endRows.size() == devices.size() && endRows.back() == tilesY);
+
+  size_t firstRow = 0;
+  for (size_t d = 0; d < devices.size(); d++) {
+    assert(endRows[d] > firstRow);
+    devices[d]->firstRow = firstRow;
+    devices[d]->endRow = endRows[d];
+    firstRow = endRows[d];
+  }
+
+  assignRows();
+}
+
+void MultiOCL_SDF::assignRows() {
+  rowOwners.resize(tilesY);
+
+  for (size_t d = 0; d < devices.size(); d++)
+    std::fill(rowOwners.begin() + devices[d]->firstRow, rowOwners.begin() + devices[d]->endRow, d);
+}
+
+void MultiOCL_SDF::uploadGainedRows(Device& device) {
+  const size_t rowPitch = width * sdf::pixelSize(format);
+
+  auto upload = [&](size_t firstRow, size_t endRow) {
+    if (firstRow >= endRow)
+      return;
+
+    const size_t origin[3] = {0, firstRow * TILE_SIZE, 0};
+    const size_t region[3] = {width, std::min(endRow * TILE_SIZE, height) - origin[1], 1};
+
+    // In order before this run's read of the same rows
+    [[maybe_unused]]
+    cl_int writeResult = clEnqueueWriteImage(device.ocl.commandQueue, device.image, CL_FALSE, origin, region, rowPitch, 0, pixels + origin[1] * rowPitch, 0, nullptr, nullptr);
+    assert(writeResult == CL_SUCCESS);
+  };
+
+  // Above and below what it held
+  if (device.heldFirstRow >= device.heldEndRow) {
+    upload(device.firstRow, device.endRow);
+    return;
+  }
+
+  upload(device.firstRow, std::min(device.endRow, device.heldFirstRow));
+  upload(std::max(device.firstRow, device.heldEndRow), device.endRow);
+}
+
+void MultiOCL_SDF::waitIdle() {
+  // The table writes are non-blocking
+  for (auto& device : devices) {
+    [[maybe_unused]]
+    cl_int finishResult = clFinish(device->ocl.commandQueue);
+    assert(finishResult == CL_SUCCESS);
+  }
+}
+
+SDF_Backend::DeviceTimes MultiOCL_SDF::takeDeviceTimes() {
+  DeviceTimes times = lastTimes;
+  lastTimes = {};
+  return times;
+}
+
+std::vector<MultiOCL_SDF::DeviceInfo> MultiOCL_SDF::getDevices() const {
+  std::vector<DeviceInfo> infos;
+  for (const auto& device : devices)
+    infos.push_back({device->ocl.getDeviceString(CL_DEVICE_NAME), device->firstRow, device->endRow, device->kernelMs, device->workPerMs});
+
+  return infos;
+}
+
+const char* MultiOCL_SDF::getName() const {
+  return "OpenCL multi";
+}
+
+bool MultiOCL_SDF::isAvailable() {
+  return !OCL_Context::findDevices().empty();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "OCL_Context.hpp"
+#include "SDF_Backend.hpp"
+
+// The OpenCL engine on every device found (GPUs, and CPU runtimes such as pocl), each with its own context and queue.
+// Each device evaluates the tiles of a band of tile rows into its own image and reads that band back into pixels.
+// The bands follow the devices' measured speed: the work of every run (the tiles' pixels times their shapes, plus one
+// per pixel) per ms of kernel time, smoothed, gives each device its share of the work, and the work last seen on every
+// tile row turns that into rows. Rows a device takes over are first uploaded from pixels, so partial runs stay exact.
+// Always synchronous, and the field always comes back to the host (no shared texture)
+class MultiOCL_SDF : public SDF_Backend {
+public:
+  MultiOCL_SDF(size_t width, size_t height, sdf::Format format = sdf::Format::RGBA8, bool printInfo = false);
+  // On these devices, a context and queue for each entry: the same device listed twice runs two bands on it
+  MultiOCL_SDF(size_t width, size_t height, std::vector<cl_device_id> ids, sdf::Format format = sdf::Format::RGBA8, bool printInfo = false);
+  ~MultiOCL_SDF();
+
+  [[nodiscard]]
+  const char* getName() const override;
+
+  // The slowest device's kernel and readback of the last run
+  [[nodiscard]]
+  DeviceTimes takeDeviceTimes() override;
+
+  struct DeviceInfo {
+    std::string name;
+    size_t firstRow;   // Band of tile rows [firstRow, endRow)
+    size_t endRow;
+    double kernelMs;  // Of the last run, 0 when it had no tiles there
+    double workPerMs; // Shape-pixel evaluations, smoothed, what the bands are sized by
+  };
+
+  [[nodiscard]]
+  std::vector<DeviceInfo> getDevices() const;
+
+  // Replaces the bands until the next rebalance (after the next run): endRows[d] ends the band of device d,
+  // increasing, the last one the tile row count
+  void setBands(const std::vector<size_t>& endRows);
+
+  // Whether there is any device to run on
+  [[nodiscard]]
+  static bool isAvailable();
+
+private:
+  struct Device {
+    explicit Device(cl_device_id id, bool printInfo) : ocl(id, printInfo) {}
+
+    OCL_Context ocl;
+    cl_program program = nullptr;
+    cl_kernel kernel = nullptr;
+
+    cl_mem image = nullptr;
+    cl_mem circles = nullptr;
+    cl_mem rects = nullptr;
+    cl_mem programWords = nullptr;
+    cl_mem groups = nullptr;
+    cl_mem tiles = nullptr;
+    cl_mem tileMaxDst = nullptr;
+    cl_mem tileShapeOffsets = nullptr;
+    cl_mem tileShapes = nullptr;
+    size_t tileShapesCapacity = 0;
+
+    // Band of tile rows, and the rows its image holds the same field as pixels
+    size_t firstRow = 0, endRow = 0;
+    size_t heldFirstRow = 0, heldEndRow = 0;
+
+    // Its part of the binning for the current run, offsets into its own shape list
+    std::vector<u32> runTiles;
+    std::vector<u32> runOffsets;
+    std::vector<u32> runShapes;
+    double runWork = 0.;
+    std::vector<float> hostTileMaxDst;
+
+    cl_event kernelDone = nullptr;
+    cl_event readDone = nullptr;
+    std::chrono::steady_clock::time_point kernelQueuedAt, readQueuedAt;
+    double kernelMs = 0.;
+    double readMs = 0.;
+    double workPerMs = 0.;
+  };
+
+  std::vector<std::unique_ptr<Device>> devices;
+
+  cl_uint numCircles = 0;
+  cl_uint numRects = 0;
+  cl_uint numGroups = 0;
+
+  // Device of every tile row
+  std::vector<size_t> rowOwners;
+
+  // Work of every tile the last time it was computed, what a full run would cost
+  std::vector<double> tileWork;
+
+  DeviceTimes lastTimes;
+
+  // Weight of the latest run in the smoothed speeds
+  static constexpr double SPEED_SMOOTHING = 0.25;
+
+private:
+  void updateCirclesBuffer(size_t begin, size_t end) override;
+  void updateRectsBuffer(size_t begin, size_t end) override;
+  void updateProgramBuffer() override;
+
+  void compute() override;
+  void waitIdle() override;
+
+  // Splits the work of the tile rows by the smoothed speeds, every device keeps a row at least
+  void rebalance();
+  // rowOwners from the bands
+  void assignRows();
+
+  // Writes the rows of pixels its band gained into the device's image
+  void uploadGainedRows(Device& device);
+};
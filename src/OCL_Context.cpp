@@ -0,0 +1,439 @@
+#include "OCL_Context.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__linux__)
+  #include <GL/glx.h>
+#endif
+
+#include "CL/cl_gl.h"
+#include "utils/types.hpp"
+#include "utils/utils.hpp"
+
+#define ATTRIBUTE_COUNT 5u
+
+const cl_platform_info attributeTypes[ATTRIBUTE_COUNT] = {
+  CL_PLATFORM_NAME,
+  CL_PLATFORM_VENDOR,
+  CL_PLATFORM_VERSION,
+  CL_PLATFORM_PROFILE,
+  CL_PLATFORM_EXTENSIONS
+};
+
+const char* const attributeNames[ATTRIBUTE_COUNT] = {
+  "CL_PLATFORM_NAME",
+  "CL_PLATFORM_VENDOR",
+  "CL_PLATFORM_VERSION",
+  "CL_PLATFORM_PROFILE",
+  "CL_PLATFORM_EXTENSIONS"
+};
+
+OCL_Context::OCL_Context(bool printInfo)
+  : OCL_Context(findDevice(), printInfo) {}
+
+OCL_Context::OCL_Context(cl_device_id device, bool printInfo)
+  : device(device) {
+  cl_platform_id platforms[64];
+  cl_uint platformCount;
+
+  [[maybe_unused]]
+  cl_int platformsResult = clGetPlatformIDs(64, platforms, &platformCount);
+  assert(platformsResult == CL_SUCCESS);
+
+  if (printInfo) {
+    for (cl_uint i = 0; i < platformCount; i++) {
+      for (size_t j = 0; j < ATTRIBUTE_COUNT; j++) {
+        // Get platform attribute value size
+        size_t infosize = 0;
+        [[maybe_unused]]
+        cl_int getPlatformInfoResult = clGetPlatformInfo(platforms[i], attributeTypes[j], 0, nullptr, &infosize);
+        assert(getPlatformInfoResult == CL_SUCCESS);
+        char* info = new char[infosize];
+
+        // Get platform attribute value
+        getPlatformInfoResult = clGetPlatformInfo(platforms[i], attributeTypes[j], infosize, info, nullptr);
+        assert(getPlatformInfoResult == CL_SUCCESS);
+
+        printf("%d.%zu %-11s: %s\n", i+1, j+1, attributeNames[j], info);
+
+        delete[] info;
+      }
+    }
+  }
+
+  assert(device);
+
+  clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(maxDimensions), &maxDimensions, nullptr);
+  clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxLocalSize), &maxLocalSize, nullptr);
+
+  if (printInfo) {
+    puts("");
+
+    printf("2.1 CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS: %zu\n", maxDimensions);
+    printf("2.2 CL_DEVICE_MAX_WORK_GROUP_SIZE: %zu\n", maxLocalSize);
+
+    size_t* maxDimensionsValues = new size_t[maxDimensions];
+    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, maxDimensions * sizeof(maxDimensionsValues[0]), maxDimensionsValues, nullptr);
+
+    printf("2.3 CL_DEVICE_MAX_WORK_ITEM_SIZES: ");
+    for (size_t i = 0; i < maxDimensions; i++) printf("%zu ", maxDimensionsValues[i]);
+    printf("\n\n");
+
+    delete[] maxDimensionsValues;
+  }
+
+  // Shared with GL when possible, so the SDF can be written straight into a texture
+  glSharing = hasExtension("cl_khr_gl_sharing") && createGLSharedContext();
+  if (printInfo)
+    printf("GL sharing: %s\n\n", glSharing ? "yes" : "no");
+
+  if (!glSharing) {
+    cl_int contextResult;
+    context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &contextResult);
+    assert(contextResult == CL_SUCCESS);
+  }
+
+  cl_int commandQueueResult;
+  commandQueue = clCreateCommandQueueWithProperties(context, device, QUEUE_PROPERTIES, &commandQueueResult);
+  assert(commandQueueResult == CL_SUCCESS);
+}
+
+OCL_Context::~OCL_Context() {
+	clReleaseCommandQueue(commandQueue);
+	clReleaseContext(context);
+	clReleaseDevice(device);
+}
+
+// FNV-1a, only has to tell builds apart
+static u64 hashString(const std::string& text, u64 hash = 0xcbf29ce484222325ull) {
+  for (char c : text) {
+    hash ^= static_cast<u8>(c);
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+// Local includes are pasted in here rather than left to the compiler: the cache key then covers them
+// and the programs don't depend on the working directory of the compiler. Only files next to the source are
+// inlined, once each, other includes stay as they are (e.g. host-only ones in a branch the kernel never takes)
+static std::string readSource(const std::filesystem::path& path, std::set<std::filesystem::path>& inlined) {
+  std::istringstream file(readFile(path.string()));
+  std::string source;
+  std::string line;
+
+  while (std::getline(file, line)) {
+    size_t open = line.find("#include \"");
+    size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 10);
+
+    std::filesystem::path includePath;
+    if (open != std::string::npos && close != std::string::npos)
+      includePath = path.parent_path() / line.substr(open + 10, close - open - 10);
+
+    std::error_code ec;
+    if (!includePath.empty() && std::filesystem::is_regular_file(includePath, ec)) {
+      if (inlined.insert(std::filesystem::weakly_canonical(includePath, ec)).second)
+        source += readSource(includePath, inlined);
+    } else {
+      source += line;
+    }
+    source += '\n';
+  }
+
+  return source;
+}
+
+cl_program OCL_Context::buildProgram(const char* path, const std::string& options) const {
+  std::string log;
+  cl_program program = tryBuildProgram(path, options, log);
+  if (!program)
+    error("Build Log ({}):\n{}\n", path, log);
+
+  return program;
+}
+
+cl_program OCL_Context::tryBuildProgram(const char* path, const std::string& options, std::string& log) const {
+  std::error_code ec;
+  std::set<std::filesystem::path> inlined = {std::filesystem::weakly_canonical(path, ec)};
+  std::string clFile = readSource(path, inlined);
+
+  // Any change of the source, the options, the device or its driver is another entry
+  std::filesystem::path cachePath;
+  if (!binaryCacheDir.empty()) {
+    u64 key = hashString(clFile);
+    key = hashString(options, key);
+    key = hashString(getDeviceString(CL_DEVICE_NAME), key);
+    key = hashString(getDeviceString(CL_DEVICE_VERSION), key);
+    key = hashString(getDeviceString(CL_DRIVER_VERSION), key);
+    cachePath = binaryCacheDir / std::format("{}-{:016x}.bin", std::filesystem::path(path).stem().string(), key);
+
+    if (cl_program program = loadBinary(cachePath, options))
+      return program;
+  }
+
+  cl_int programResult;
+  const char* programSource = clFile.c_str();
+  size_t programSourceLength = 0;
+  cl_program program = clCreateProgramWithSource(context, 1, &programSource, &programSourceLength, &programResult);
+  assert(programResult == CL_SUCCESS);
+
+  cl_int buildResult = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+  if (buildResult != CL_SUCCESS) {
+    size_t logSize;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+    log.resize(logSize);
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, log.data(), NULL);
+    clReleaseProgram(program);
+    return nullptr;
+  }
+
+  if (!cachePath.empty())
+    saveBinary(cachePath, program);
+
+  return program;
+}
+
+cl_program OCL_Context::loadBinary(const std::filesystem::path& cachePath, const std::string& options) const {
+  std::ifstream file(cachePath, std::ios::binary);
+  if (!file)
+    return nullptr;
+
+  std::vector<unsigned char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  const unsigned char* binaryData = binary.data();
+  const size_t binarySize = binary.size();
+
+  cl_int binaryStatus;
+  cl_int programResult;
+  cl_program program = clCreateProgramWithBinary(context, 1, &device, &binarySize, &binaryData, &binaryStatus, &programResult);
+  if (programResult != CL_SUCCESS || binaryStatus != CL_SUCCESS)
+    return nullptr;
+
+  // Still needed for a binary, it's only a link step. A stale or corrupt entry is rebuilt from source
+  if (clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr) != CL_SUCCESS) {
+    clReleaseProgram(program);
+    return nullptr;
+  }
+
+  return program;
+}
+
+void OCL_Context::saveBinary(const std::filesystem::path& cachePath, cl_program program) const {
+  size_t binarySize = 0;
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, nullptr) != CL_SUCCESS || binarySize == 0)
+    return;
+
+  std::vector<unsigned char> binary(binarySize);
+  unsigned char* binaryData = binary.data();
+  if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaryData), &binaryData, nullptr) != CL_SUCCESS)
+    return;
+
+  // Not worth failing over, the next start builds from source again
+  std::error_code ec;
+  std::filesystem::create_directories(cachePath.parent_path(), ec);
+
+  // Written aside and renamed over the entry, so another process (or build) never loads half a binary.
+  // The name only has to differ between writers
+  std::filesystem::path tempPath = cachePath;
+  tempPath += std::format(".{:08x}.tmp", std::random_device{}());
+
+  {
+    std::ofstream file(tempPath, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+    if (!file.flush()) {
+      file.close();
+      std::filesystem::remove(tempPath, ec);
+      return;
+    }
+  }
+
+  std::filesystem::rename(tempPath, cachePath, ec);
+  if (ec)
+    std::filesystem::remove(tempPath, ec);
+}
+
+OCL_Context::CommandTime OCL_Context::commandTime(cl_event event, std::chrono::steady_clock::time_point queuedAt) {
+  cl_ulong queued = 0, start = 0, end = 0;
+  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, nullptr);
+  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+  clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+
+  // The device clock has its own origin, only the differences carry over
+  auto waited = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(start - queued));
+  return {static_cast<double>(end - start) * 1e-6, queuedAt + waited};
+}
+
+cl_kernel OCL_Context::createKernel(cl_program program, const char* name) const {
+  cl_int kernelResult;
+  cl_kernel kernel = clCreateKernel(program, name, &kernelResult);
+  assert(kernelResult == CL_SUCCESS);
+
+  return kernel;
+}
+
+std::string OCL_Context::getDeviceString(cl_device_info info) const {
+  size_t size = 0;
+  if (clGetDeviceInfo(device, info, 0, nullptr, &size) != CL_SUCCESS)
+    return "";
+
+  std::string value(size, '\0');
+  clGetDeviceInfo(device, info, size, value.data(), nullptr);
+  value.resize(std::strlen(value.c_str()));
+
+  return value;
+}
+
+bool OCL_Context::hasExtension(const char* name) const {
+  size_t extensionsSize = 0;
+  if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &extensionsSize) != CL_SUCCESS)
+    return false;
+
+  std::string extensions(extensionsSize, '\0');
+  if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, extensionsSize, extensions.data(), nullptr) != CL_SUCCESS)
+    return false;
+
+  // Space separated list
+  extensions.resize(std::strlen(extensions.c_str()));
+  extensions = " " + extensions + " ";
+  return extensions.find(" " + std::string(name) + " ") != std::string::npos;
+}
+
+bool OCL_Context::createGLSharedContext() {
+  cl_platform_id platform;
+  if (clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, nullptr) != CL_SUCCESS)
+    return false;
+
+  #if defined(_WIN32)
+    HGLRC glContext = wglGetCurrentContext();
+    if (!glContext)
+      return false;
+
+    const cl_context_properties properties[] = {
+      CL_GL_CONTEXT_KHR, reinterpret_cast<cl_context_properties>(glContext),
+      CL_WGL_HDC_KHR, reinterpret_cast<cl_context_properties>(wglGetCurrentDC()),
+      CL_CONTEXT_PLATFORM, reinterpret_cast<cl_context_properties>(platform),
+      0
+    };
+  #elif defined(__linux__)
+    GLXContext glContext = glXGetCurrentContext();
+    if (!glContext)
+      return false;
+
+    const cl_context_properties properties[] = {
+      CL_GL_CONTEXT_KHR, reinterpret_cast<cl_context_properties>(glContext),
+      CL_GLX_DISPLAY_KHR, reinterpret_cast<cl_context_properties>(glXGetCurrentDisplay()),
+      CL_CONTEXT_PLATFORM, reinterpret_cast<cl_context_properties>(platform),
+      0
+    };
+  #else
+    return false;
+  #endif
+
+  #if defined(_WIN32) || defined(__linux__)
+    // Extension function, has to be looked up
+    auto getGLContextInfo = reinterpret_cast<clGetGLContextInfoKHR_fn>(
+      clGetExtensionFunctionAddressForPlatform(platform, "clGetGLContextInfoKHR")
+    );
+    if (!getGLContextInfo)
+      return false;
+
+    // The texture would have to go through the host anyway
+    cl_device_id glDevice = nullptr;
+    cl_int glDeviceResult = getGLContextInfo(properties, CL_CURRENT_DEVICE_FOR_GL_CONTEXT_KHR, sizeof(glDevice), &glDevice, nullptr);
+    if (glDeviceResult != CL_SUCCESS || glDevice != device)
+      return false;
+
+    cl_int contextResult;
+    context = clCreateContext(properties, 1, &device, nullptr, nullptr, &contextResult);
+    return contextResult == CL_SUCCESS;
+  #endif
+}
+
+bool OCL_Context::isAvailable() {
+  return findDevice() != nullptr;
+}
+
+cl_device_id OCL_Context::findDevice() {
+  cl_platform_id platforms[64];
+  cl_uint platformCount;
+  cl_device_id device = nullptr;
+
+  // No ICD or no platforms installed
+  if (clGetPlatformIDs(64, platforms, &platformCount) != CL_SUCCESS)
+    return nullptr;
+
+  for (cl_uint i = 0; i < platformCount; i++) {
+    cl_device_id devices[64];
+    cl_uint deviceCount;
+    cl_int deviceResult = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 64, devices, &deviceCount);
+
+    if (deviceResult == CL_SUCCESS) {
+      for (cl_uint j = 0; j < deviceCount; j++) {
+        char vendorName[256];
+        size_t vendorNameLength;
+        cl_int deviceInfoResult = clGetDeviceInfo(devices[j], CL_DEVICE_VENDOR, 256, vendorName, &vendorNameLength);
+        if (deviceInfoResult == CL_SUCCESS) {
+          device = devices[j];
+          break;
+        }
+      }
+    }
+  }
+
+  return device;
+}
+
+std::vector<cl_device_id> OCL_Context::findDevices() {
+  cl_platform_id platforms[64];
+  cl_uint platformCount;
+  std::vector<cl_device_id> gpus;
+  std::vector<cl_device_id> others;
+  std::vector<std::string> cpuNames;
+
+  if (clGetPlatformIDs(64, platforms, &platformCount) != CL_SUCCESS)
+    return {};
+
+  for (cl_uint i = 0; i < platformCount; i++) {
+    cl_device_id devices[64];
+    cl_uint deviceCount;
+    if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 64, devices, &deviceCount) != CL_SUCCESS)
+      continue;
+
+    for (cl_uint j = 0; j < deviceCount; j++) {
+      cl_device_type type;
+      char name[256];
+      if (clGetDeviceInfo(devices[j], CL_DEVICE_TYPE, sizeof(type), &type, nullptr) != CL_SUCCESS ||
+          clGetDeviceInfo(devices[j], CL_DEVICE_NAME, sizeof(name), name, nullptr) != CL_SUCCESS)
+        continue;
+
+      if (type & CL_DEVICE_TYPE_GPU) {
+        gpus.push_back(devices[j]);
+        continue;
+      }
+
+      // pocl and a vendor runtime on the same cores would only fight over them
+      if (type & CL_DEVICE_TYPE_CPU) {
+        name[sizeof(name) - 1] = '\0';
+        if (std::find(cpuNames.begin(), cpuNames.end(), name) != cpuNames.end())
+          continue;
+        cpuNames.push_back(name);
+      }
+
+      others.push_back(devices[j]);
+    }
+  }
+
+  gpus.insert(gpus.end(), others.begin(), others.end());
+  return gpus;
+}
+
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "CL/cl.h"
+
+// Device, context and command queue of the OpenCL engines
+struct OCL_Context {
+  cl_device_id device = nullptr;
+  cl_context context = nullptr;
+  cl_command_queue commandQueue = nullptr;
+
+  size_t maxLocalSize = 0;
+  size_t maxDimensions = 0;
+
+  // The context shares objects with the GL context that was current at creation (cl_khr_gl_sharing)
+  bool glSharing = false;
+
+  // Of every queue the engines create, commands carry their start and end timestamps
+  static constexpr cl_queue_properties QUEUE_PROPERTIES[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+
+  // On findDevice()
+  explicit OCL_Context(bool printInfo = false);
+  OCL_Context(cl_device_id device, bool printInfo = false);
+  ~OCL_Context();
+
+  OCL_Context(const OCL_Context&) = delete;
+  OCL_Context& operator=(const OCL_Context&) = delete;
+
+  // Compiled programs are kept there, keyed by device, driver, options and source. Empty disables the cache
+  inline static std::filesystem::path binaryCacheDir = ".cache/cl";
+
+  // Loaded from the binary cache when the same build was done before. Exits with the build log if the program doesn't compile
+  [[nodiscard]]
+  cl_program buildProgram(const char* path, const std::string& options = "") const;
+
+  // Same, but nullptr with the build log filled in when it doesn't compile
+  [[nodiscard]]
+  cl_program tryBuildProgram(const char* path, const std::string& options, std::string& log) const;
+
+  [[nodiscard]]
+  cl_kernel createKernel(cl_program program, const char* name) const;
+
+  // A finished command of a profiled queue: how long it ran and when it started on the host clock. The device's
+  // timestamps are placed after queuedAt, the host time the command was enqueued at
+  struct CommandTime {
+    double ms = 0.;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  [[nodiscard]]
+  static CommandTime commandTime(cl_event event, std::chrono::steady_clock::time_point queuedAt);
+
+  // A command kept to be measured once it's done
+  struct ProfiledCommand {
+    cl_event event = nullptr;
+    std::chrono::steady_clock::time_point queuedAt;
+  };
+
+  // Whether there is a device to run on
+  [[nodiscard]]
+  static bool isAvailable();
+
+  [[nodiscard]]
+  static cl_device_id findDevice();
+
+  // Every device of every platform, GPUs first. A CPU exposed by several runtimes is only listed once
+  [[nodiscard]]
+  static std::vector<cl_device_id> findDevices();
+
+  [[nodiscard]]
+  std::string getDeviceString(cl_device_info info) const;
+
+private:
+  [[nodiscard]]
+  bool hasExtension(const char* name) const;
+
+  // nullptr on a miss, or when the driver refuses the binary
+  [[nodiscard]]
+  cl_program loadBinary(const std::filesystem::path& cachePath, const std::string& options) const;
+  void saveBinary(const std::filesystem::path& cachePath, cl_program program) const;
+
+  // Fails when there is no current GL context or it runs on another device
+  [[nodiscard]]
+  bool createGLSharedContext();
+};
+
@@ -1,113 +1,49 @@
 #include "OCL_SDF.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <format>
 #include <string>
 
-#include "utils/utils.hpp"
+#include <SFML/OpenGL.hpp>
 
-#define ATTRIBUTE_COUNT 5u
+#include "CL/cl_gl.h"
 
-const cl_platform_info attributeTypes[ATTRIBUTE_COUNT] = {
-  CL_PLATFORM_NAME,
-  CL_PLATFORM_VENDOR,
-  CL_PLATFORM_VERSION,
-  CL_PLATFORM_PROFILE,
-  CL_PLATFORM_EXTENSIONS
-};
-
-const char* const attributeNames[ATTRIBUTE_COUNT] = {
-  "CL_PLATFORM_NAME",
-  "CL_PLATFORM_VENDOR",
-  "CL_PLATFORM_VERSION",
-  "CL_PLATFORM_PROFILE",
-  "CL_PLATFORM_EXTENSIONS"
-};
-
-OCL_SDF::OCL_SDF(size_t width, size_t height, bool printInfo)
-  : width(width), height(height), imageSize(width * height), pixels(new u8[width * height * 4]){
-
-  cl_platform_id platforms[64];
-  cl_uint platformCount;
-
-  [[maybe_unused]]
-  cl_int platformsResult = clGetPlatformIDs(64, platforms, &platformCount);
-  assert(platformsResult == CL_SUCCESS);
-
-  if (printInfo) {
-    for (cl_uint i = 0; i < platformCount; i++) {
-      for (size_t j = 0; j < ATTRIBUTE_COUNT; j++) {
-        // Get platform attribute value size
-        size_t infosize = 0;
-        [[maybe_unused]]
-        cl_int getPlatformInfoResult = clGetPlatformInfo(platforms[i], attributeTypes[j], 0, nullptr, &infosize);
-        assert(getPlatformInfoResult == CL_SUCCESS);
-        char* info = new char[infosize];
-
-        // Get platform attribute value
-        getPlatformInfoResult = clGetPlatformInfo(platforms[i], attributeTypes[j], infosize, info, nullptr);
-        assert(getPlatformInfoResult == CL_SUCCESS);
-
-        printf("%d.%zu %-11s: %s\n", i+1, j+1, attributeNames[j], info);
-
-        delete[] info;
-      }
-    }
-  }
-
-  for (cl_uint i = 0; i < platformCount; i++) {
-    cl_device_id devices[64];
-    cl_uint deviceCount;
-    cl_int deviceResult = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 64, devices, &deviceCount);
-
-    if (deviceResult == CL_SUCCESS) {
-      for (cl_uint j = 0; j < deviceCount; j++) {
-        char vendorName[256];
-        size_t vendorNameLength;
-        cl_int deviceInfoResult = clGetDeviceInfo(devices[j], CL_DEVICE_VENDOR, 256, vendorName, &vendorNameLength);
-        if (deviceInfoResult == CL_SUCCESS) {
-          device = devices[j];
-          break;
-        }
-      }
-    }
-  }
-
-  assert(device);
-
-  if (printInfo) {
-    puts("");
-
-    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(maxDimensions), &maxDimensions, nullptr);
-    printf("2.1 CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS: %zu\n", maxDimensions);
+// Replaces the kept event, retaining the new one. Called right after the enqueue, the host time stands for its queueing
+static void keepEvent(OCL_Context::ProfiledCommand& kept, cl_event event) {
+  if (kept.event) clReleaseEvent(kept.event);
+  kept.event = event;
+  kept.queuedAt = std::chrono::steady_clock::now();
+  if (kept.event) clRetainEvent(kept.event);
+}
 
-    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxLocalSize), &maxLocalSize, nullptr);
-    printf("2.2 CL_DEVICE_MAX_WORK_GROUP_SIZE: %zu\n", maxLocalSize);
+// Zero until the command is done, the event is released once measured
+static OCL_Context::CommandTime takeCommandTime(OCL_Context::ProfiledCommand& command) {
+  if (!command.event)
+    return {};
 
-    size_t* maxDimensionsValues = new size_t[maxDimensions];
-    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, maxDimensions * sizeof(maxDimensionsValues[0]), maxDimensionsValues, nullptr);
+  cl_int status;
+  clGetEventInfo(command.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+  if (status != CL_COMPLETE)
+    return {};
 
-    printf("2.3 CL_DEVICE_MAX_WORK_ITEM_SIZES: ");
-    for (size_t i = 0; i < maxDimensions; i++) printf("%zu ", maxDimensionsValues[i]);
-    printf("\n\n");
+  OCL_Context::CommandTime time = OCL_Context::commandTime(command.event, command.queuedAt);
+  clReleaseEvent(command.event);
+  command.event = nullptr;
 
-    delete[] maxDimensionsValues;
-  }
-
-  cl_int contextResult;
-  context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &contextResult);
-  assert(contextResult == CL_SUCCESS);
+  return time;
+}
 
-  cl_int commandQueueResult;
-  commandQueue = clCreateCommandQueueWithProperties(context, device, 0, &commandQueueResult);
-  assert(commandQueueResult == CL_SUCCESS);
+OCL_SDF::OCL_SDF(size_t width, size_t height, sdf::Format format, bool printInfo)
+  : SDF_Backend(width, height, format), ocl(printInfo) {
 
-  cl_image_format format;
-  format.image_channel_order = CL_RGBA;
-  format.image_channel_data_type = CL_UNORM_INT8; // (8-bit per channel) Probably the reason of appearing black outlines
+  // write_imagef converts distance / width to the storage format
+  const cl_image_format imageFormat = sdf::clImageFormat(format);
 
-  // NOTE: Would be better to share the texture directly using OpenCL/OpenGL interoperability
+  // Written by the kernel unless shareTexture() gave it the GL texture itself
   cl_int gpuImageMallocResult;
   #ifdef CL_VERSION_1_2
     cl_image_desc imageDesc;
@@ -115,170 +51,546 @@ OCL_SDF::OCL_SDF(size_t width, size_t height, bool printInfo)
     imageDesc.image_type = CL_MEM_OBJECT_IMAGE2D;
     imageDesc.image_width = width;
     imageDesc.image_height = height;
-    gpuImage = clCreateImage(context, CL_MEM_WRITE_ONLY, &format, &imageDesc, nullptr, &gpuImageMallocResult);
+    gpuImage = clCreateImage(ocl.context, CL_MEM_WRITE_ONLY, &imageFormat, &imageDesc, nullptr, &gpuImageMallocResult);
   #else
-    gpuImage = clCreateImage2D(context, CL_MEM_WRITE_ONLY, &format, width, height, 0, nullptr, &gpuImageMallocResult);
+    gpuImage = clCreateImage2D(ocl.context, CL_MEM_WRITE_ONLY, &imageFormat, width, height, 0, nullptr, &gpuImageMallocResult);
   #endif
   assert(gpuImageMallocResult == CL_SUCCESS);
 
-  cl_int programResult;
-  std::string clFile = readFile("res/cl/SDF.cl");
-  const char* programSource = clFile.c_str();
-  size_t programSourceLength = 0;
-  program = clCreateProgramWithSource(context, 1, &programSource, &programSourceLength, &programResult);
-  assert(programResult == CL_SUCCESS);
+  // Tile list of the current run and the largest distance of each tile
+  cl_int gpuTilesMallocResult;
+  gpuTiles = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY, sizeof(cl_uint) * getTileCount(), nullptr, &gpuTilesMallocResult);
+  assert(gpuTilesMallocResult == CL_SUCCESS);
 
-  [[maybe_unused]]
-  cl_int buildResult = clBuildProgram(program, 1, &device, nullptr, nullptr, nullptr);
-  if (buildResult != CL_SUCCESS) {
-    size_t logSize;
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
-    char *log = new char[logSize];
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, log, NULL);
-    error("Build Log:\n{}\n", log);
-  }
+  gpuTileMaxDst = clCreateBuffer(ocl.context, CL_MEM_WRITE_ONLY, sizeof(cl_float) * getTileCount(), nullptr, &gpuTilesMallocResult);
+  assert(gpuTilesMallocResult == CL_SUCCESS);
 
-  cl_int kernelResult;
-  kernel = clCreateKernel(program, "calcSDF", &kernelResult);
-  assert(kernelResult == CL_SUCCESS);
+  gpuTileShapeOffsets = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY, sizeof(cl_uint) * (getTileCount() + 1), nullptr, &gpuTilesMallocResult);
+  assert(gpuTilesMallocResult == CL_SUCCESS);
 
-  [[maybe_unused]]
-  cl_int kernelArgResult = clSetKernelArg(kernel, 0, sizeof(cl_mem), &gpuImage);
-  assert(kernelArgResult == CL_SUCCESS);
+  reserveTileShapes(1024);
+
+  clGetDeviceInfo(ocl.device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(maxConstantBufferSize), &maxConstantBufferSize, nullptr);
+  clGetDeviceInfo(ocl.device, CL_DEVICE_MAX_CONSTANT_ARGS, sizeof(maxConstantArgs), &maxConstantArgs, nullptr);
+
+  baseBuildOptions = getBaseBuildOptions();
+
+  // The generic kernel, the variants are built when a scene first needs them
+  addKernel("", ocl.buildProgram("res/cl/SDF.cl", baseBuildOptions));
 }
 
 OCL_SDF::~OCL_SDF() {
-  if (pixels) delete[] pixels;
-  clearHostCicles();
-  clearHostRectangles();
+  waitIdle();
+  if (build.valid())
+    if (cl_program program = build.get())
+      clReleaseProgram(program);
+
+  releaseStaging();
+  if (readQueue) clReleaseCommandQueue(readQueue);
+  if (profiledKernel.event) clReleaseEvent(profiledKernel.event);
+  if (profiledRead.event) clReleaseEvent(profiledRead.event);
 
   if (gpuImage) clReleaseMemObject(gpuImage);
+  if (glImage) clReleaseMemObject(glImage);
+  if (gpuTiles) clReleaseMemObject(gpuTiles);
+  if (gpuTileMaxDst) clReleaseMemObject(gpuTileMaxDst);
+  if (gpuTileShapeOffsets) clReleaseMemObject(gpuTileShapeOffsets);
+  if (gpuTileShapes) clReleaseMemObject(gpuTileShapes);
   clearGpuCicles();
   clearGpuRectangles();
+  clearGpuProgram();
 
-	clReleaseKernel(kernel);
-	clReleaseProgram(program);
-	clReleaseCommandQueue(commandQueue);
-	clReleaseContext(context);
-	clReleaseDevice(device);
+  for (auto& [options, variantKernel] : kernels) {
+    clReleaseKernel(variantKernel.kernel);
+    clReleaseProgram(variantKernel.program);
+  }
 }
 
-void OCL_SDF::updateCirclesBuffer(const std::vector<sf::CircleShape>& circles) {
-  if (circles.size() != numCircles || gpuCircles == nullptr)
+// NOTE: The writes are non-blocking, the host copy must stay untouched until waitIdle() finishes the queue
+void OCL_SDF::updateCirclesBuffer(size_t begin, size_t end) {
+  if (circles.size() != numCircles)
     createCirclesBuffer(circles.size());
 
-  for (size_t i = 0; i < numCircles; i++) {
-    cl_float2 clPos;
-    cl_float3 clCol;
-
-    const sf::CircleShape& circle = circles[i];
-    float radius = circle.getRadius();
-    sf::Vector2f pos = circle.getPosition();
-    sf::Vector2f origin = circle.getOrigin();
-    pos.x += radius - origin.x;
-    pos.y += radius - origin.y;
-    sf::Color col = circle.getFillColor();
+  if (begin == end)
+    return;
 
-    clPos = {{pos.x, pos.y}};
+  [[maybe_unused]]
+  cl_int hostCopyResult = clEnqueueWriteBuffer(ocl.commandQueue, gpuCircles, CL_FALSE, sizeof(Circle) * begin, sizeof(Circle) * (end - begin), circles.data() + begin, 0, nullptr, nullptr);
+  assert(hostCopyResult == CL_SUCCESS);
+  writesPending = true;
+}
 
-    clCol.x = col.r / 255.f;
-    clCol.y = col.g / 255.f;
-    clCol.z = col.b / 255.f;
+void OCL_SDF::updateRectsBuffer(size_t begin, size_t end) {
+  if (rects.size() != numRects)
+    createRectsBuffer(rects.size());
 
-    hostCircles[i] = {clPos, radius, clCol};
-  }
+  if (begin == end)
+    return;
 
   [[maybe_unused]]
-  cl_int hostCopyResult = clEnqueueWriteBuffer(commandQueue, gpuCircles, CL_TRUE, 0, sizeof(Circle) * numCircles, hostCircles, 0, nullptr, nullptr);
+  cl_int hostCopyResult = clEnqueueWriteBuffer(ocl.commandQueue, gpuRectangles, CL_FALSE, sizeof(Rectangle) * begin, sizeof(Rectangle) * (end - begin), rects.data() + begin, 0, nullptr, nullptr);
   assert(hostCopyResult == CL_SUCCESS);
+  writesPending = true;
 }
 
-void OCL_SDF::updateRectsBuffer(const std::vector<sf::RectangleShape>& rects) {
-  if (rects.size() != numRects || gpuRectangles == nullptr)
-    createRectsBuffer(rects.size());
+void OCL_SDF::updateProgramBuffer() {
+  clearGpuProgram();
 
-  for (size_t i = 0; i < numRects; i++) {
-    cl_float2 clSizeFromCenter;
-    cl_float2 clCenterGlobal;
-    cl_float3 clCol;
+  numGroups = static_cast<cl_uint>(program.getGroupCount());
+  if (numGroups == 0)
+    return;
 
-    const sf::RectangleShape& rect = rects[i];
-    sf::Vector2f origin = rect.getOrigin();
-    sf::Vector2f sizeFromCenter = rect.getGeometricCenter();
-    sf::Vector2f centerGlobal = rect.getPosition() + sizeFromCenter - origin;
-    sf::Color col = rect.getFillColor();
+  const std::vector<cl_float4>& words = program.getWords();
+  const std::vector<sdf::ShapeGroup>& groups = program.getGroups();
 
-    clCenterGlobal = {{centerGlobal.x, centerGlobal.y}};
-    clSizeFromCenter = {{sizeFromCenter.x, sizeFromCenter.y}};
+  // Copied at creation, the host copy may change right after
+  cl_int gpuMallocResult;
+  gpuProgram = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_float4) * words.size(), const_cast<cl_float4*>(words.data()), &gpuMallocResult);
+  assert(gpuMallocResult == CL_SUCCESS);
 
-    clCol.x = col.r / 255.f;
-    clCol.y = col.g / 255.f;
-    clCol.z = col.b / 255.f;
+  gpuGroups = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(sdf::ShapeGroup) * groups.size(), const_cast<sdf::ShapeGroup*>(groups.data()), &gpuMallocResult);
+  assert(gpuMallocResult == CL_SUCCESS);
+}
 
-    hostRectangles[i] = {clCenterGlobal, clSizeFromCenter, clCol};
+void OCL_SDF::compute() {
+  const std::vector<u32>& tiles = binning.getTiles();
+  const std::vector<u32>& tileShapeOffsets = binning.getOffsets();
+  const std::vector<u32>& tileShapes = binning.getEntries();
+
+  reserveTileShapes(tileShapes.size());
+
+  // One work-group per listed tile
+  constexpr size_t localWorkSize[2] = {TILE_SIZE, TILE_SIZE};
+  const size_t globalWorkSize[2] = {tiles.size() * TILE_SIZE, TILE_SIZE};
+
+  // Only the bounding box of the evaluated tiles has to come back
+  TileRect computedTiles = {tilesX, tilesY, 0, 0};
+  for (u32 tileEntry : tiles) {
+    u32 tile = tileEntry & ~TileBinning::FULL_SCAN_BIT;
+    computedTiles.minX = std::min(computedTiles.minX, tile % tilesX);
+    computedTiles.minY = std::min(computedTiles.minY, tile / tilesX);
+    computedTiles.maxX = std::max(computedTiles.maxX, tile % tilesX);
+    computedTiles.maxY = std::max(computedTiles.maxY, tile / tilesX);
   }
 
-  [[maybe_unused]]
-  cl_int hostCopyResult = clEnqueueWriteBuffer(commandQueue, gpuRectangles, CL_TRUE, 0, sizeof(Rectangle) * numRects, hostRectangles, 0, nullptr, nullptr);
-  assert(hostCopyResult == CL_SUCCESS);
-}
-
-void OCL_SDF::run() {
-  constexpr size_t origin[3] = {0, 0, 0};
-  const size_t region[3] = {width, height, 1};
+  variant = specialization ? selectVariant() : "";
+  cl_kernel kernel = findKernel(variant);
 
-  constexpr size_t localWorkSize[2] = {16, 16};
-  const size_t globalWorkSize[2] = {
-    (width  + (localWorkSize[0] - 1) / localWorkSize[0]) * localWorkSize[0],
-    (height + (localWorkSize[1] - 1) / localWorkSize[1]) * localWorkSize[1]
-  };
+  // Same field until the variant is built
+  if (!kernel) {
+    variant.clear();
+    kernel = kernels.at(variant).kernel;
+  }
 
   [[maybe_unused]]
   cl_int errCode;
 
+  errCode = clSetKernelArg(kernel, 0, sizeof(cl_mem), glImage ? &glImage : &gpuImage); assert(errCode == CL_SUCCESS);
+
   errCode = clSetKernelArg(kernel, 1, sizeof(cl_mem), &gpuCircles);  assert(errCode == CL_SUCCESS);
   errCode = clSetKernelArg(kernel, 2, sizeof(cl_uint), &numCircles); assert(errCode == CL_SUCCESS);
 
   errCode = clSetKernelArg(kernel, 3, sizeof(cl_mem), &gpuRectangles); assert(errCode == CL_SUCCESS);
   errCode = clSetKernelArg(kernel, 4, sizeof(cl_uint), &numRects);     assert(errCode == CL_SUCCESS);
 
-  errCode = clEnqueueNDRangeKernel(commandQueue, kernel, 2, nullptr, globalWorkSize, localWorkSize, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
-  errCode = clEnqueueReadImage(commandQueue, gpuImage, CL_TRUE, origin, region, 0, 0, pixels, 0, nullptr, nullptr);       assert(errCode == CL_SUCCESS);
+  errCode = clSetKernelArg(kernel, 8, sizeof(cl_mem), &gpuTileShapes); assert(errCode == CL_SUCCESS);
+
+  errCode = clSetKernelArg(kernel, 9, sizeof(cl_mem), &gpuProgram);   assert(errCode == CL_SUCCESS);
+  errCode = clSetKernelArg(kernel, 10, sizeof(cl_mem), &gpuGroups);   assert(errCode == CL_SUCCESS);
+  errCode = clSetKernelArg(kernel, 11, sizeof(cl_uint), &numGroups);  assert(errCode == CL_SUCCESS);
+
+  errCode = clEnqueueWriteBuffer(ocl.commandQueue, gpuTiles, CL_FALSE, 0, sizeof(cl_uint) * tiles.size(), tiles.data(), 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+  errCode = clEnqueueWriteBuffer(ocl.commandQueue, gpuTileShapeOffsets, CL_FALSE, 0, sizeof(cl_uint) * tileShapeOffsets.size(), tileShapeOffsets.data(), 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+  if (!tileShapes.empty()) {
+    errCode = clEnqueueWriteBuffer(ocl.commandQueue, gpuTileShapes, CL_FALSE, 0, sizeof(cl_uint) * tileShapes.size(), tileShapes.data(), 0, nullptr, nullptr);
+    assert(errCode == CL_SUCCESS);
+  }
+
+  // GL must be done with the texture before OpenCL takes it
+  if (glImage) {
+    glFinish();
+    errCode = clEnqueueAcquireGLObjects(ocl.commandQueue, 1, &glImage, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+  }
+
+  // Pipelined: the staging buffer of this run has to be free
+  const bool pipelined = !glImage && !staging.empty();
+  if (pipelined && stagingInFlight == staging.size())
+    landStaging(true);
+
+  cl_event kernelDone = nullptr;
+  errCode = clEnqueueNDRangeKernel(
+    ocl.commandQueue, kernel, 2, nullptr, globalWorkSize, localWorkSize,
+    lastRead ? 1 : 0, lastRead ? &lastRead : nullptr, &kernelDone
+  );
+  assert(errCode == CL_SUCCESS);
+
+  keepEvent(profiledKernel, kernelDone);
+
+  errCode = clEnqueueReadBuffer(ocl.commandQueue, gpuTileMaxDst, CL_FALSE, 0, sizeof(cl_float) * getTileCount(), tileMaxDst.data(), 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+
+  if (pipelined) {
+    Staging& slot = staging[(oldestStaging + stagingInFlight) % staging.size()];
+    slot.tiles = computedTiles;
+    enqueueReadImage(readQueue, gpuImage, computedTiles, slot.hostPixels, &kernelDone, &slot.ready);
+    keepEvent(profiledRead, slot.ready);
+
+    clReleaseEvent(kernelDone);
+    if (lastRead) clReleaseEvent(lastRead);
+    lastRead = slot.ready;
+    clRetainEvent(lastRead);
+
+    stagingInFlight++;
+    pixelsOnDevice = true;
+
+    // Only submitted, waitIdle() finishes it before the host copies change
+    errCode = clFlush(ocl.commandQueue); assert(errCode == CL_SUCCESS);
+    errCode = clFlush(readQueue);        assert(errCode == CL_SUCCESS);
+    computeInFlight = true;
+    return;
+  }
 
-  errCode = clFinish(commandQueue); assert(errCode == CL_SUCCESS);
+  clReleaseEvent(kernelDone);
+
+  if (glImage) {
+    errCode = clEnqueueReleaseGLObjects(ocl.commandQueue, 1, &glImage, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+
+    // Already in the texture, the host copy is only brought up to date when someone asks for it
+    if (!pixelsOnDevice)
+      pendingTiles = computedTiles;
+
+    pendingTiles.minX = std::min(pendingTiles.minX, computedTiles.minX);
+    pendingTiles.minY = std::min(pendingTiles.minY, computedTiles.minY);
+    pendingTiles.maxX = std::max(pendingTiles.maxX, computedTiles.maxX);
+    pendingTiles.maxY = std::max(pendingTiles.maxY, computedTiles.maxY);
+    pixelsOnDevice = true;
+  } else {
+    cl_event readDone;
+    enqueueReadImage(ocl.commandQueue, gpuImage, computedTiles, pixels, nullptr, &readDone);
+    keepEvent(profiledRead, readDone);
+    clReleaseEvent(readDone);
+  }
+
+  errCode = clFinish(ocl.commandQueue); assert(errCode == CL_SUCCESS);
+  writesPending = false;
 }
 
-const u8* OCL_SDF::getPixels() const {
-  return pixels;
+std::string OCL_SDF::selectVariant() const {
+  std::string options;
+
+  if (numCircles == 0) options += " -D HAS_CIRCLES=0";
+  if (numRects == 0)   options += " -D HAS_RECTS=0";
+  if (numGroups == 0)  options += " -D HAS_GROUPS=0";
+
+  // Each count is another program, only for the small scenes where the loop overhead shows.
+  // The groups aren't unrolled, their words are only known at run time
+  if (numGroups == 0 && numCircles + numRects <= MAX_UNROLLED_SHAPES)
+    options += std::format(" -D FIXED_SHAPES -D FIXED_CIRCLES={} -D FIXED_RECTS={}", numCircles, numRects);
+
+  // Cached close to the cores, as long as both tables fit together
+  size_t shapesSize = sizeof(Circle) * numCircles + sizeof(Rectangle) * numRects;
+  if (maxConstantArgs >= 2 && shapesSize > 0 && shapesSize <= maxConstantBufferSize)
+    options += " -D CONSTANT_SHAPES";
+
+  return options;
+}
+
+cl_kernel OCL_SDF::findKernel(const std::string& variant) {
+  auto it = kernels.find(variant);
+  if (it != kernels.end())
+    return it->second.kernel;
+
+  if (failedVariants.contains(variant))
+    return nullptr;
+
+  if (build.valid()) {
+    if (build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return nullptr;
+
+    // Kept even when another variant is wanted by now, the scene may come back to it
+    cl_kernel built = takeBuild();
+    return buildingVariant == variant ? built : nullptr;
+  }
+
+  // The build only reads the context, the device and the source, the OpenCL calls are thread-safe
+  buildingVariant = variant;
+  build = std::async(std::launch::async, [this, options = baseBuildOptions + variant]() {
+    std::string log;
+    cl_program program = ocl.tryBuildProgram("res/cl/SDF.cl", options, log);
+    if (!program)
+      fprintf(stderr, "Variant build failed (%s):\n%s\n", options.c_str(), log.c_str());
+
+    return program;
+  });
+
+  return nullptr;
+}
+
+cl_kernel OCL_SDF::addKernel(const std::string& variant, cl_program program) {
+  Kernel variantKernel;
+  variantKernel.program = program;
+  variantKernel.kernel = ocl.createKernel(variantKernel.program, "calcSDF");
+
+  [[maybe_unused]]
+  cl_int kernelArgResult;
+  kernelArgResult = clSetKernelArg(variantKernel.kernel, 5, sizeof(cl_mem), &gpuTiles);      assert(kernelArgResult == CL_SUCCESS);
+  kernelArgResult = clSetKernelArg(variantKernel.kernel, 6, sizeof(cl_mem), &gpuTileMaxDst); assert(kernelArgResult == CL_SUCCESS);
+  kernelArgResult = clSetKernelArg(variantKernel.kernel, 7, sizeof(cl_mem), &gpuTileShapeOffsets); assert(kernelArgResult == CL_SUCCESS);
+
+  kernels.emplace(variant, variantKernel);
+  return variantKernel.kernel;
+}
+
+void OCL_SDF::setSpecialization(bool enabled) {
+  specialization = enabled;
+}
+
+cl_kernel OCL_SDF::takeBuild() {
+  cl_program program = build.get();
+  if (!program) {
+    failedVariants.insert(buildingVariant);
+    return nullptr;
+  }
+
+  return addKernel(buildingVariant, program);
+}
+
+void OCL_SDF::finishBuilds() {
+  if (build.valid())
+    takeBuild();
+}
+
+const std::string& OCL_SDF::getVariant() const {
+  return variant;
+}
+
+void OCL_SDF::readPixels(Fetch fetch) {
+  if (!glImage) {
+    while (landStaging(fetch == Fetch::Exact)) {}
+
+    pixelsOnDevice = stagingInFlight > 0;
+    return;
+  }
+
+  [[maybe_unused]]
+  cl_int errCode;
+
+  glFinish();
+  errCode = clEnqueueAcquireGLObjects(ocl.commandQueue, 1, &glImage, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+  cl_event readDone;
+  enqueueReadImage(ocl.commandQueue, glImage, pendingTiles, pixels, nullptr, &readDone);
+  keepEvent(profiledRead, readDone);
+  clReleaseEvent(readDone);
+  errCode = clEnqueueReleaseGLObjects(ocl.commandQueue, 1, &glImage, 0, nullptr, nullptr); assert(errCode == CL_SUCCESS);
+
+  errCode = clFinish(ocl.commandQueue); assert(errCode == CL_SUCCESS);
+
+  pixelsChanged = true;
+  pixelsOnDevice = false;
+}
+
+void OCL_SDF::waitIdle() {
+  if (!computeInFlight && !writesPending)
+    return;
+
+  [[maybe_unused]]
+  cl_int finishResult = clFinish(ocl.commandQueue);
+  assert(finishResult == CL_SUCCESS);
+
+  computeInFlight = false;
+  writesPending = false;
+}
+
+bool OCL_SDF::setPipelineDepth(size_t depth) {
+  // Whatever is in flight lands first
+  waitIdle();
+  while (landStaging(true)) {}
+  if (!glImage)
+    pixelsOnDevice = false;
+  releaseStaging();
+
+  if (depth == 0)
+    return true;
+
+  [[maybe_unused]]
+  cl_int errCode;
+
+  if (!readQueue) {
+    readQueue = clCreateCommandQueueWithProperties(ocl.context, ocl.device, OCL_Context::QUEUE_PROPERTIES, &errCode);
+    assert(errCode == CL_SUCCESS);
+  }
+
+  // ALLOC_HOST_PTR + map gives page-locked memory on most drivers, the copies skip a bounce buffer
+  const size_t imageBytes = imageSize * sdf::pixelSize(format);
+  staging.resize(depth);
+  for (Staging& slot : staging) {
+    slot.buffer = clCreateBuffer(ocl.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, imageBytes, nullptr, &errCode);
+    assert(errCode == CL_SUCCESS);
+
+    slot.hostPixels = static_cast<u8*>(clEnqueueMapBuffer(readQueue, slot.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, imageBytes, 0, nullptr, nullptr, &errCode));
+    assert(errCode == CL_SUCCESS);
+  }
+
+  return true;
+}
+
+bool OCL_SDF::landStaging(bool wait) {
+  if (stagingInFlight == 0)
+    return false;
+
+  Staging& slot = staging[oldestStaging];
+
+  if (!wait) {
+    cl_int status;
+    clGetEventInfo(slot.ready, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr);
+    if (status != CL_COMPLETE)
+      return false;
+  }
+
+  [[maybe_unused]]
+  cl_int waitResult = clWaitForEvents(1, &slot.ready);
+  assert(waitResult == CL_SUCCESS);
+
+  clReleaseEvent(slot.ready);
+  slot.ready = nullptr;
+
+  // Same layout in both, only the rows of the read tiles
+  const size_t pixelBytes = sdf::pixelSize(format);
+  const size_t x0 = slot.tiles.minX * TILE_SIZE;
+  const size_t y0 = slot.tiles.minY * TILE_SIZE;
+  const size_t x1 = std::min((slot.tiles.maxX + 1) * TILE_SIZE, width);
+  const size_t y1 = std::min((slot.tiles.maxY + 1) * TILE_SIZE, height);
+
+  for (size_t y = y0; y < y1; y++) {
+    size_t offset = (y * width + x0) * pixelBytes;
+    memcpy(pixels + offset, slot.hostPixels + offset, (x1 - x0) * pixelBytes);
+  }
+
+  oldestStaging = (oldestStaging + 1) % staging.size();
+  stagingInFlight--;
+  pixelsChanged = true;
+
+  return true;
+}
+
+void OCL_SDF::releaseStaging() {
+  for (Staging& slot : staging) {
+    if (slot.ready) clReleaseEvent(slot.ready);
+    clEnqueueUnmapMemObject(readQueue, slot.buffer, slot.hostPixels, 0, nullptr, nullptr);
+  }
+
+  if (readQueue) clFinish(readQueue);
+  for (Staging& slot : staging)
+    clReleaseMemObject(slot.buffer);
+
+  if (lastRead) clReleaseEvent(lastRead);
+  lastRead = nullptr;
+
+  staging.clear();
+  oldestStaging = 0;
+  stagingInFlight = 0;
+}
+
+void OCL_SDF::enqueueReadImage(cl_command_queue queue, cl_mem image, const TileRect& tiles, u8* dst, const cl_event* waitFor, cl_event* event) {
+  const size_t origin[3] = {tiles.minX * TILE_SIZE, tiles.minY * TILE_SIZE, 0};
+  const size_t region[3] = {
+    std::min((tiles.maxX + 1) * TILE_SIZE, width) - origin[0],
+    std::min((tiles.maxY + 1) * TILE_SIZE, height) - origin[1],
+    1
+  };
+  const size_t rowPitch = width * sdf::pixelSize(format);
+  u8* regionPixels = dst + origin[1] * rowPitch + origin[0] * sdf::pixelSize(format);
+
+  [[maybe_unused]]
+  cl_int readResult = clEnqueueReadImage(queue, image, CL_FALSE, origin, region, rowPitch, 0, regionPixels, waitFor ? 1 : 0, waitFor, event);
+  assert(readResult == CL_SUCCESS);
+}
+
+bool OCL_SDF::shareTexture(const sf::Texture& texture) {
+  if (!ocl.glSharing || texture.getSize() != sf::Vector2u(width, height))
+    return false;
+
+  cl_int sharedImageResult;
+  cl_mem sharedImage = clCreateFromGLTexture(ocl.context, CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, texture.getNativeHandle(), &sharedImageResult);
+  if (sharedImageResult != CL_SUCCESS)
+    return false;
+
+  // Written in place, nothing to pipeline
+  setPipelineDepth(0);
+
+  if (glImage) clReleaseMemObject(glImage);
+  glImage = sharedImage;
+
+  // The texture doesn't hold the field yet
+  invalidate();
+
+  return true;
+}
+
+SDF_Backend::DeviceTimes OCL_SDF::takeDeviceTimes() {
+  OCL_Context::CommandTime kernel = takeCommandTime(profiledKernel);
+  OCL_Context::CommandTime read = takeCommandTime(profiledRead);
+  return {kernel.ms, read.ms, kernel.start, read.start};
+}
+
+const char* OCL_SDF::getName() const {
+  return "OpenCL";
+}
+
+bool OCL_SDF::isAvailable() {
+  return OCL_Context::isAvailable();
+}
+
+std::string OCL_SDF::getBaseBuildOptions() {
+  return std::format(
+    "-D TILE_SIZE={} -D FULL_SCAN_BIT={}u -D RECT_BIT={}u -D GROUP_BIT={}u",
+    TILE_SIZE, TileBinning::FULL_SCAN_BIT, TileBinning::RECT_BIT, TileBinning::GROUP_BIT
+  );
 }
 
 void OCL_SDF::createCirclesBuffer(int count) {
-  clearHostCicles();
   clearGpuCicles();
 
   numCircles = count;
-  hostCircles = new Circle[numCircles];
+  if (numCircles == 0)
+    return;
 
   cl_int gpuMallocResult;
-  gpuCircles = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(Circle) * numCircles, nullptr, &gpuMallocResult);
+  gpuCircles = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY, sizeof(Circle) * numCircles, nullptr, &gpuMallocResult);
   assert(gpuMallocResult == CL_SUCCESS);
 }
 
 void OCL_SDF::createRectsBuffer(int count) {
-  clearHostRectangles();
   clearGpuRectangles();
 
   numRects = count;
-  hostRectangles = new Rectangle[numRects];
+  if (numRects == 0)
+    return;
 
   cl_int gpuMallocResult;
-  gpuRectangles = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(Rectangle) * numRects, nullptr, &gpuMallocResult);
+  gpuRectangles = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY, sizeof(Rectangle) * numRects, nullptr, &gpuMallocResult);
   assert(gpuMallocResult == CL_SUCCESS);
 }
 
-void OCL_SDF::clearHostCicles()     { if (hostCircles)    delete[] hostCircles;    }
-void OCL_SDF::clearHostRectangles() { if (hostRectangles) delete[] hostRectangles; }
+void OCL_SDF::reserveTileShapes(size_t count) {
+  if (count <= tileShapesCapacity)
+    return;
+
+  if (gpuTileShapes) clReleaseMemObject(gpuTileShapes);
+
+  tileShapesCapacity = std::max(count, tileShapesCapacity * 2);
 
-void OCL_SDF::clearGpuCicles()      { if (gpuCircles)    clReleaseMemObject(gpuCircles);    }
-void OCL_SDF::clearGpuRectangles()  { if (gpuRectangles) clReleaseMemObject(gpuRectangles); }
+  cl_int gpuMallocResult;
+  gpuTileShapes = clCreateBuffer(ocl.context, CL_MEM_READ_ONLY, sizeof(cl_uint) * tileShapesCapacity, nullptr, &gpuMallocResult);
+  assert(gpuMallocResult == CL_SUCCESS);
+}
+
+void OCL_SDF::clearGpuCicles()      { if (gpuCircles)    clReleaseMemObject(gpuCircles);    gpuCircles = nullptr;    }
+void OCL_SDF::clearGpuRectangles()  { if (gpuRectangles) clReleaseMemObject(gpuRectangles); gpuRectangles = nullptr; }
+
+void OCL_SDF::clearGpuProgram() {
+  if (gpuProgram) clReleaseMemObject(gpuProgram);
+  if (gpuGroups) clReleaseMemObject(gpuGroups);
+  gpuProgram = nullptr;
+  gpuGroups = nullptr;
+}
 
@@ -1,66 +1,153 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
-#include "CL/cl.h"
-#include "utils/types.hpp"
+#include "OCL_Context.hpp"
+#include "SDF_Backend.hpp"
 
-class OCL_SDF {
+class OCL_SDF : public SDF_Backend {
 public:
-  OCL_SDF(size_t width, size_t height, bool printInfo = false);
+  OCL_SDF(size_t width, size_t height, sdf::Format format = sdf::Format::RGBA8, bool printInfo = false);
   ~OCL_SDF();
 
-  void updateCirclesBuffer(const std::vector<sf::CircleShape>& circles);
-  void updateRectsBuffer(const std::vector<sf::RectangleShape>& rects);
+  [[nodiscard]]
+  const char* getName() const override;
+
+  // Needs a GL context current at construction and cl_khr_gl_sharing. The texture storage has to match the format
+  bool shareTexture(const sf::Texture& texture) override;
 
-  void run();
+  // Readbacks go through pinned staging buffers on a second queue. No effect on a shared texture
+  bool setPipelineDepth(size_t depth) override;
 
+  // From the profiling timestamps of the last kernel and image readback
   [[nodiscard]]
-  const u8* getPixels() const;
+  DeviceTimes takeDeviceTimes() override;
 
-private:
-  const size_t width, height;
-  const size_t imageSize;
-  u8* pixels = nullptr;
-
-  struct Circle {
-    cl_float2 center;
-    cl_float radius;
-    cl_float3 color;
-  };
+  // Kernels built for the scene at hand (on by default), see selectVariant(). Off always runs the generic one.
+  // A variant is built in the background when a scene first needs it, the generic kernel runs until it's ready
+  void setSpecialization(bool enabled);
 
-  struct Rectangle {
-    cl_float2 center;
-    cl_float2 sizeFromCenter;
-    cl_float3 color;
-  };
+  // Blocks until the variant in the background is built, the next run takes it
+  void finishBuilds();
 
-  Circle* hostCircles = nullptr;
-  cl_uint numCircles = 0;
+  // Build options of the variant the last run used, on top of the common ones. Empty for the generic kernel
+  [[nodiscard]]
+  const std::string& getVariant() const;
 
-  Rectangle* hostRectangles = nullptr;
-  cl_uint numRects = 0;
+  // Whether there is a device this backend can run on
+  [[nodiscard]]
+  static bool isAvailable();
 
-  cl_device_id device = nullptr;
-  size_t maxLocalSize;
-  size_t maxDimensions;
+  // Options every build of res/cl/SDF.cl needs, before any variant
+  [[nodiscard]]
+  static std::string getBaseBuildOptions();
+
+private:
+  cl_uint numCircles = 0;
+  cl_uint numRects = 0;
+  cl_uint numGroups = 0;
 
-  cl_context context;
-  cl_command_queue commandQueue;
+  OCL_Context ocl;
 
   cl_mem gpuImage = nullptr;
+  cl_mem glImage = nullptr; // The shared texture, written instead of gpuImage
   cl_mem gpuCircles = nullptr;
   cl_mem gpuRectangles = nullptr;
+  cl_mem gpuProgram = nullptr;
+  cl_mem gpuGroups = nullptr;
+  cl_mem gpuTiles = nullptr;
+  cl_mem gpuTileMaxDst = nullptr;
+  cl_mem gpuTileShapeOffsets = nullptr;
+  cl_mem gpuTileShapes = nullptr;
+  size_t tileShapesCapacity = 0;
+
+  // Up to this many shapes the counts are compiled in and the loops unrolled
+  static constexpr cl_uint MAX_UNROLLED_SHAPES = 8;
+
+  // By the variant's build options, built on first use
+  struct Kernel {
+    cl_program program;
+    cl_kernel kernel;
+  };
+
+  std::unordered_map<std::string, Kernel> kernels;
+
+  // One build at a time off the render thread, a scene needing another variant meanwhile asks again on its next run
+  std::string buildingVariant;
+  std::future<cl_program> build;
+
+  // Didn't compile, never asked for again, the generic kernel stays in use
+  std::unordered_set<std::string> failedVariants;
+  std::string baseBuildOptions;
+  std::string variant;
+  bool specialization = true;
+
+  cl_ulong maxConstantBufferSize = 0;
+  cl_uint maxConstantArgs = 0;
+
+  // Tiles written into glImage since the last readback, inclusive
+  struct TileRect {
+    size_t minX, minY, maxX, maxY;
+  } pendingTiles = {};
+
+  // Pipelined runs: the tiles of each run land in a staging buffer (mapped for its whole lifetime)
+  // and are copied into pixels once its readback is done
+  struct Staging {
+    cl_mem buffer = nullptr;
+    u8* hostPixels = nullptr;
+    cl_event ready = nullptr;
+    TileRect tiles = {};
+  };
 
-  cl_kernel kernel;
-  cl_program program;
+  cl_command_queue readQueue = nullptr;
+  std::vector<Staging> staging;
+  size_t oldestStaging = 0;
+  size_t stagingInFlight = 0;
+
+  // The next kernel must not overwrite the image before the last readback has it
+  cl_event lastRead = nullptr;
+  bool computeInFlight = false;
+  // Shape writes still reading from the host vectors
+  bool writesPending = false;
+
+  // Latest kernel and image readback, kept until takeDeviceTimes() reports them
+  OCL_Context::ProfiledCommand profiledKernel;
+  OCL_Context::ProfiledCommand profiledRead;
 
 private:
+  void updateCirclesBuffer(size_t begin, size_t end) override;
+  void updateRectsBuffer(size_t begin, size_t end) override;
+  void updateProgramBuffer() override;
+
+  [[nodiscard]]
+  std::string selectVariant() const;
+
+  // nullptr while the variant isn't built yet (its build is started then) or when it failed to build
+  cl_kernel findKernel(const std::string& variant);
+  cl_kernel addKernel(const std::string& variant, cl_program program);
+  cl_kernel takeBuild();
+
+  void compute() override;
+  void readPixels(Fetch fetch) override;
+  void waitIdle() override;
+
+  // Non-blocking read of the tiles of the image into dst (same layout as pixels)
+  void enqueueReadImage(cl_command_queue queue, cl_mem image, const TileRect& tiles, u8* dst, const cl_event* waitFor = nullptr, cl_event* event = nullptr);
+
+  // Copies the oldest staging buffer into pixels. Without wait only if its readback is already done
+  bool landStaging(bool wait);
+  void releaseStaging();
+
   void createCirclesBuffer(int count);
   void createRectsBuffer(int count);
-
-  void clearHostCicles();
-  void clearHostRectangles();
+  void reserveTileShapes(size_t count);
 
   void clearGpuCicles();
   void clearGpuRectangles();
+  void clearGpuProgram();
 };
 
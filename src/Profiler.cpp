@@ -0,0 +1,97 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+
+Profiler::Scope::Scope(Profiler& profiler, const char* name)
+  : profiler(profiler), name(name), start(Clock::now()) {}
+
+Profiler::Scope::~Scope() {
+  double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  profiler.add(name, Track::CPU, start, ms);
+}
+
+Profiler::Profiler()
+  : epoch(Clock::now()) {}
+
+void Profiler::record(const char* name, double ms, Clock::time_point start, Track track) {
+  add(name, track, start, ms);
+}
+
+void Profiler::add(const char* name, Track track, Clock::time_point start, double ms) {
+  Stage& stage = findStage(name);
+  if (stage.samples.size() < WINDOW)
+    stage.samples.push_back(static_cast<float>(ms));
+  else
+    stage.samples[stage.next] = static_cast<float>(ms);
+  stage.next = (stage.next + 1) % WINDOW;
+
+  Event event = {name, track, std::chrono::duration<double, std::micro>(start - epoch).count(), ms * 1000.};
+  if (events.size() < MAX_EVENTS)
+    events.push_back(event);
+  else
+    events[nextEvent] = event;
+  nextEvent = (nextEvent + 1) % MAX_EVENTS;
+}
+
+Profiler::Stage& Profiler::findStage(const char* name) {
+  for (Stage& stage : stages)
+    if (stage.name == name || strcmp(stage.name, name) == 0)
+      return stage;
+
+  stages.push_back({name, {}, 0});
+  stages.back().samples.reserve(WINDOW);
+  return stages.back();
+}
+
+Profiler::Percentiles Profiler::getPercentiles(const char* name) const {
+  for (const Stage& stage : stages) {
+    if (strcmp(stage.name, name) != 0 || stage.samples.empty())
+      continue;
+
+    std::vector<float> sorted = stage.samples;
+    std::sort(sorted.begin(), sorted.end());
+
+    auto at = [&](double p) { return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5)]; };
+    return {at(0.50), at(0.95), at(0.99)};
+  }
+
+  return {};
+}
+
+std::string Profiler::summary() const {
+  std::string text = std::format("{:<20}{:>8}{:>8}{:>8}", "ms", "p50", "p95", "p99");
+
+  for (const Stage& stage : stages) {
+    Percentiles percentiles = getPercentiles(stage.name);
+    text += std::format("\n{:<20}{:>8.2f}{:>8.2f}{:>8.2f}", stage.name, percentiles.p50, percentiles.p95, percentiles.p99);
+  }
+
+  return text;
+}
+
+bool Profiler::writeChromeTrace(const std::filesystem::path& path) const {
+  std::ofstream file(path);
+  if (!file)
+    return false;
+
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"Device\"}}";
+
+  // Oldest first once the ring has wrapped
+  size_t first = events.size() < MAX_EVENTS ? 0 : nextEvent;
+  for (size_t i = 0; i < events.size(); i++) {
+    const Event& event = events[(first + i) % events.size()];
+    file << std::format(
+      ",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":0,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+      event.name, static_cast<int>(event.track), event.startUs, event.durationUs
+    );
+  }
+
+  file << "\n]}\n";
+  return static_cast<bool>(file);
+}
+
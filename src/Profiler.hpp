@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Frame stages timed on the CPU (Scope) or reported by a device (record). A Scope around GL calls only times their
+// submission, the driver runs them later. Keeps a rolling window of
+// every stage for the percentiles and the recent events for a Chrome trace (chrome://tracing, Perfetto).
+// Stage names must outlive the profiler, string literals
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum Track {
+    CPU,
+    Device
+  };
+
+  struct Scope {
+    Scope(Profiler& profiler, const char* name);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Profiler& profiler;
+    const char* name;
+    Clock::time_point start;
+  };
+
+  struct Percentiles {
+    double p50 = 0.;
+    double p95 = 0.;
+    double p99 = 0.;
+  };
+
+  Profiler();
+
+  // A duration measured elsewhere, from start on the profiler's clock
+  void record(const char* name, double ms, Clock::time_point start, Track track = Track::Device);
+
+  [[nodiscard]]
+  Percentiles getPercentiles(const char* name) const;
+
+  // One "name  p50  p95  p99" line per stage, in order of first appearance
+  [[nodiscard]]
+  std::string summary() const;
+
+  bool writeChromeTrace(const std::filesystem::path& path) const;
+
+private:
+  static constexpr size_t WINDOW = 240;
+  static constexpr size_t MAX_EVENTS = 100'000;
+
+  struct Stage {
+    const char* name;
+    std::vector<float> samples;
+    size_t next = 0;
+  };
+
+  struct Event {
+    const char* name;
+    Track track;
+    double startUs;
+    double durationUs;
+  };
+
+  Clock::time_point epoch;
+  std::vector<Stage> stages;
+
+  // Ring buffer, the oldest events are dropped
+  std::vector<Event> events;
+  size_t nextEvent = 0;
+
+private:
+  void add(const char* name, Track track, Clock::time_point start, double ms);
+  Stage& findStage(const char* name);
+};
+
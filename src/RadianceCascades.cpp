@@ -0,0 +1,78 @@
+#include "RadianceCascades.hpp"
+
+#include <cmath>
+
+#include "utils/utils.hpp"
+
+RadianceCascades::RadianceCascades(sf::Vector2u size, float baseInterval, int stepsPerInterval)
+  : baseInterval(baseInterval),
+    cascadeShader(fspath("src/rc.frag"), sf::Shader::Type::Fragment),
+    drawShader(fspath("src/rc_draw.frag"), sf::Shader::Type::Fragment) {
+  cascadeShader.setUniform("u_baseInterval", baseInterval);
+  cascadeShader.setUniform("u_stepsPerInterval", stepsPerInterval);
+  resize(size);
+}
+
+void RadianceCascades::resize(sf::Vector2u size) {
+  this->size = size;
+
+  // Enough cascades for the intervals to reach across the diagonal
+  float diagonal = sf::Vector2f(size).length();
+  cascadeCount = 1;
+  while (baseInterval * (std::pow(4.f, cascadeCount) - 1.f) / 3.f < diagonal)
+    cascadeCount++;
+
+  // Every cascade holds 4 texels per pixel. Rounded up so the top cascade's probe blocks aren't cut
+  unsigned int topSpacing = 1u << (cascadeCount - 1);
+  sf::Vector2u cascadeSize(
+    (size.x + topSpacing - 1) / topSpacing * topSpacing * 2,
+    (size.y + topSpacing - 1) / topSpacing * topSpacing * 2
+  );
+
+  for (sf::RenderTexture& cascade : cascades)
+    if (!cascade.resize(cascadeSize))
+      error("Can't create a {}x{} cascade texture", cascadeSize.x, cascadeSize.y);
+
+  cascadeRect.setSize(sf::Vector2f(cascadeSize));
+  screenRect.setSize(sf::Vector2f(size));
+
+  cascadeShader.setUniform("u_resolution", sf::Glsl::Vec2(size));
+  cascadeShader.setUniform("u_cascadeCount", cascadeCount);
+  drawShader.setUniform("u_resolution", sf::Glsl::Vec2(size));
+}
+
+void RadianceCascades::render(sf::RenderTarget& target, const sf::Texture& scene, const sf::Texture& sdf) {
+  cascadeShader.setUniform("u_baseTexture", scene);
+  cascadeShader.setUniform("u_sdfTexture", sdf);
+
+  // Every texel is written, alpha is the visibility and must not be blended
+  sf::RenderStates states(&cascadeShader);
+  states.blendMode = sf::BlendNone;
+
+  for (int n = cascadeCount - 1; n >= 0; n--) {
+    sf::RenderTexture& cascade = cascades[n % 2];
+
+    cascadeShader.setUniform("u_cascade", n);
+    if (n + 1 < cascadeCount)
+      cascadeShader.setUniform("u_upperCascade", cascades[(n + 1) % 2].getTexture());
+
+    cascade.draw(cascadeRect, states);
+    cascade.display();
+  }
+
+  drawShader.setUniform("u_baseTexture", scene);
+  drawShader.setUniform("u_cascade0", cascades[0].getTexture());
+
+  if (target.getSize() == size) {
+    target.draw(screenRect, &drawShader);
+    return;
+  }
+
+  if (fluence.getSize() != size && !fluence.resize(size))
+    error("Can't create a {}x{} fluence texture", size.x, size.y);
+
+  fluence.draw(screenRect, &drawShader);
+  fluence.display();
+  upsample.draw(target, fluence.getTexture(), scene);
+}
+
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Upsample.hpp"
+#include "utils/types.hpp"
+
+// Global illumination with Radiance Cascades, as fragment passes over the scene and its SDF.
+// Cascade n has probes every 2^n pixels with 4^(n+1) rays each, each cascade's interval is 4x
+// longer than the previous one, so every cascade costs the same and the total is fixed by the
+// resolution, not by the number of lights or rays. See src/rc.frag for the layout
+class RadianceCascades {
+public:
+  // size: of cascade 0, one probe per pixel. The scene and the field can be of any size
+  RadianceCascades(sf::Vector2u size, float baseInterval = 1.f, int stepsPerInterval = 32);
+
+  void resize(sf::Vector2u size);
+
+  // Builds the cascades from the top one down and draws cascade 0's fluence into target, upsampled (see Upsample)
+  // when target is larger. scene is then what guides it, at the target's size
+  void render(sf::RenderTarget& target, const sf::Texture& scene, const sf::Texture& sdf);
+
+  int getCascadeCount() const { return cascadeCount; }
+
+private:
+  sf::Vector2u size;
+  float baseInterval;
+  int cascadeCount = 0;
+
+  sf::Shader cascadeShader;
+  sf::Shader drawShader;
+
+  // Ping-pong, each cascade only reads the one above it
+  sf::RenderTexture cascades[2];
+  sf::RectangleShape cascadeRect;
+  sf::RectangleShape screenRect;
+
+  // Cascade 0's fluence when the target is larger
+  sf::RenderTexture fluence;
+  Upsample upsample;
+};
+
@@ -3,66 +3,120 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <numbers>
 
-#include "defines.hpp"
+// What the sf::Shape versions looked like: translucent fill, opaque outline outside of the shape
+constexpr sf::Color CIRCLE_FILL = {30, 30, 30, 40};
+constexpr sf::Color CIRCLE_OUTLINE = {90, 90, 90, 255};
+constexpr float CIRCLE_OUTLINE_THICKNESS = 2.f;
 
-Ray::Ray(sf::Vector2f origin, size_t maxMarches)
-  : origin(origin), maxMarches(maxMarches) {
-  circleBase.setFillColor({30, 30, 30, 40});
-  circleBase.setOutlineThickness(2.f);
-  circleBase.setOutlineColor({90, 90, 90, 255});
-  circleBase.setPointCount(100);
-  circleBase.setRadius(1.f);
-  circleBase.setOrigin({1.f, 1.f});
-  circleBase.setPosition(origin);
-};
+// Segments of a circle, about one per pixel of radius: small steps stay cheap, the large ones stay round
+constexpr size_t MIN_CIRCLE_POINTS = 12;
+constexpr size_t MAX_CIRCLE_POINTS = 100;
+
+static void appendQuad(sf::VertexArray& vertices, sf::Vector2f a, sf::Vector2f b, sf::Vector2f c, sf::Vector2f d, sf::Color color) {
+  vertices.append({a, color, {}});
+  vertices.append({b, color, {}});
+  vertices.append({c, color, {}});
+  vertices.append({a, color, {}});
+  vertices.append({c, color, {}});
+  vertices.append({d, color, {}});
+}
+
+static void appendCircle(sf::VertexArray& vertices, sf::Vector2f center, float radius) {
+  size_t points = std::clamp(static_cast<size_t>(radius), MIN_CIRCLE_POINTS, MAX_CIRCLE_POINTS);
+  float angle = 2.f * std::numbers::pi_v<float> / points;
+  sf::Vector2f rotation{std::cos(angle), std::sin(angle)};
+  float outer = radius + CIRCLE_OUTLINE_THICKNESS;
+
+  // Unit vector rotated one segment at a time
+  sf::Vector2f dir{1.f, 0.f};
+  for (size_t i = 0; i < points; i++) {
+    sf::Vector2f next{dir.x * rotation.x - dir.y * rotation.y, dir.x * rotation.y + dir.y * rotation.x};
+
+    vertices.append({center, CIRCLE_FILL, {}});
+    vertices.append({center + dir * radius, CIRCLE_FILL, {}});
+    vertices.append({center + next * radius, CIRCLE_FILL, {}});
+
+    appendQuad(vertices, center + dir * radius, center + dir * outer, center + next * outer, center + next * radius, CIRCLE_OUTLINE);
+    dir = next;
+  }
+}
+
+Ray::Ray(sf::Vector2f origin, size_t maxMarches, sf::Vector2u bounds)
+  : origin(origin), maxMarches(maxMarches), bounds(bounds) {}
+
+void Ray::setBounds(sf::Vector2u bounds) {
+  this->bounds = bounds;
+}
 
 void Ray::update(sf::Vector2i mousePos) {
   sf::Vector2f mousePosClamped(
-    std::clamp(mousePos.x, 0, (int)WIDTH),
-    std::clamp(mousePos.y, 0, (int)HEIGHT)
+    std::clamp(mousePos.x, 0, (int)bounds.x),
+    std::clamp(mousePos.y, 0, (int)bounds.y)
   );
 
   sf::Vector2f v = mousePosClamped - origin;
   length = v.length();
   direction = v / length;
 
-  line[0].position = origin;
-  line[1].position = origin + direction * length;
-  rayCircles.clear();
+  // Only the line until march()
+  marched = length;
+  steps.clear();
+  geometryStale = true;
 }
 
-void Ray::march(const u8* sdfPixels) {
+void Ray::march(const u8* sdfPixels, sdf::Format format, sf::Vector2u fieldSize) {
+  stats = {};
+  steps.clear();
+
+  // Field pixels per scene pixel. The values are normalized by the field width, which covers the scene width
+  float scale = static_cast<float>(fieldSize.x) / bounds.x;
+
   sf::Vector2f currentOrigin = origin;
   float currentLength = 0.f;
+  stats.rays = 1;
 
   for (size_t i = 0; currentLength < length && i < maxMarches; i++) {
-    size_t px = static_cast<size_t>(currentOrigin.x);
-    size_t py = static_cast<size_t>(currentOrigin.y);
-    size_t pixIdx = (py * WIDTH + px) * 4; // [R, G, B, A, R, G, B, A, ...]
-    float dstToScene = sdfPixels[pixIdx] / 255.f * WIDTH;
+    size_t px = std::min<size_t>(static_cast<size_t>(std::max(currentOrigin.x * scale, 0.f)), fieldSize.x - 1u);
+    size_t py = std::min<size_t>(static_cast<size_t>(std::max(currentOrigin.y * scale, 0.f)), fieldSize.y - 1u);
+    float dstToScene = sdf::load(format, sdfPixels, py * fieldSize.x + px) * bounds.x;
+    stats.fetches++;
 
-    if (dstToScene < 10.f)
+    if (dstToScene < HIT_DST) {
+      stats.hits++;
       break;
+    }
 
-    sf::CircleShape newCircle(circleBase);
-    newCircle.setRadius(dstToScene);
-    newCircle.setPosition(currentOrigin);
-    newCircle.setOrigin(sf::Vector2f{dstToScene, dstToScene});
-    rayCircles.push_back(newCircle);
+    steps.push_back({currentOrigin, dstToScene});
 
     currentOrigin += direction * dstToScene;
     currentLength += dstToScene;
+    stats.steps++;
   }
 
-  line[1].position = origin + direction * currentLength;
+  marched = currentLength;
+  geometryStale = true;
+}
+
+void Ray::appendGeometry(sf::VertexArray& out) const {
+  for (const Step& step : steps)
+    appendCircle(out, step.position, step.distance);
+
+  // One pixel wide, white stays white when added
+  sf::Vector2f normal{-direction.y * 0.5f, direction.x * 0.5f};
+  sf::Vector2f end = origin + direction * marched;
+  appendQuad(out, origin - normal, end - normal, end + normal, origin + normal, sf::Color::White);
 }
 
 void Ray::draw(sf::RenderTarget& target, sf::RenderStates states) const {
-  target.draw(line);
-  states.blendMode = sf::BlendAdd;
+  if (geometryStale) {
+    vertices.clear();
+    appendGeometry(vertices);
+    geometryStale = false;
+  }
 
-  for (const sf::CircleShape& circle : rayCircles)
-    target.draw(circle, states);
+  states.blendMode = sf::BlendAdd;
+  target.draw(vertices, states);
 }
 
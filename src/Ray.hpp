@@ -1,26 +1,64 @@
 #pragma once
 
-#include <list>
+#include <vector>
 
-#include "OCL_SDF.hpp"
+#include "SDF_Backend.hpp"
 
+// A single marched ray and its steps, drawn as one triangle list: the line and a disc per step, built when drawn.
+// The storage is reused from one march to the next, it only grows when a march takes more steps than any before
 class Ray : public sf::Drawable {
 public:
-  Ray(sf::Vector2f origin, size_t maxMarches);
+  // bounds: size of the scene, the ray ends inside of it
+  Ray(sf::Vector2f origin, size_t maxMarches, sf::Vector2u bounds);
+
+  void setBounds(sf::Vector2u bounds);
 
   void update(sf::Vector2i mousePos);
-  void march(const u8* sdfPixels);
+
+  // Sphere tracing through the field, up to maxMarches reads. The field (fieldSize) covers the whole scene at any scale
+  // (see SDF_Backend::setScale), the steps are in scene pixels
+  void march(const u8* sdfPixels, sdf::Format format, sf::Vector2u fieldSize);
+
+  struct Stats {
+    size_t rays = 0;
+    size_t hits = 0;
+    size_t steps = 0;   // Moves along the ray
+    size_t fetches = 0; // Reads of the field, the steps plus the one that hit
+  };
+
+  // Of the last march()
+  [[nodiscard]]
+  const Stats& getStats() const { return stats; }
+
+  // Adds the geometry of the last march() to vertices (triangles, meant for sf::BlendAdd), so many rays can go
+  // out in a single draw call
+  void appendGeometry(sf::VertexArray& vertices) const;
+
   void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
 
 private:
+  // Closer than this to the scene counts as a hit
+  static constexpr float HIT_DST = 10.f;
+
   sf::Vector2f origin;
   size_t maxMarches;
+  sf::Vector2u bounds;
 
   sf::Vector2f direction;
   float length;
+  float marched = 0.f;
+
+  // From position, distance is what the field gave there (px)
+  struct Step {
+    sf::Vector2f position;
+    float distance;
+  };
+
+  Stats stats;
+  std::vector<Step> steps;
 
-  sf::CircleShape circleBase;
-  sf::VertexArray line{sf::PrimitiveType::Lines, 2};
-  std::list<sf::CircleShape> rayCircles;
+  // Rebuilt by draw() after update() or march()
+  mutable sf::VertexArray vertices{sf::PrimitiveType::Triangles};
+  mutable bool geometryStale = true;
 };
 
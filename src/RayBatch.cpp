@@ -0,0 +1,198 @@
+#include "RayBatch.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#endif
+
+#if defined(__AVX2__)
+  constexpr size_t LANES = 8;
+#else
+  constexpr size_t LANES = 1;
+#endif
+
+// Enough rays per chunk for the pool's overhead not to show
+constexpr size_t MIN_RAYS_PER_CHUNK = 256;
+
+RayBatch::RayBatch(size_t threadCount)
+  : threadPool(threadCount) {}
+
+void RayBatch::setField(const u8* pixels, sdf::Format format, size_t width, size_t height) {
+  this->width = width;
+  this->height = height;
+
+  if (format == sdf::Format::R32F) {
+    field = reinterpret_cast<const float*>(pixels);
+    return;
+  }
+
+  fieldCopy.resize(width * height);
+  threadPool.parallelFor(height, [&](size_t begin, size_t end) {
+    for (size_t i = begin * width; i < end * width; i++)
+      fieldCopy[i] = sdf::load(format, pixels, i);
+  }, 16);
+
+  field = fieldCopy.data();
+}
+
+void RayBatch::marchBatch(std::span<const sf::Vector2f> origins, std::span<const sf::Vector2f> directions, float maxDist, std::span<Hit> hits) {
+  assert(origins.size() == directions.size() && origins.size() == hits.size());
+  assert(field);
+
+  threadPool.parallelFor(origins.size(), [&](size_t begin, size_t end) {
+    marchRange(origins.data() + begin, directions.data() + begin, end - begin, maxDist, hits.data() + begin);
+  }, MIN_RAYS_PER_CHUNK);
+}
+
+#if defined(__AVX2__)
+
+// Each lane takes the next ray of the range as soon as its own is done, the lanes don't wait for the slowest ray
+void RayBatch::marchRange(const sf::Vector2f* origins, const sf::Vector2f* directions, size_t count, float maxDist, Hit* hits) const {
+  alignas(32) float laneOx[LANES];
+  alignas(32) float laneOy[LANES];
+  alignas(32) float laneDx[LANES];
+  alignas(32) float laneDy[LANES];
+  alignas(32) float laneT[LANES];
+  alignas(32) u32 laneSteps[LANES];
+  alignas(32) u32 laneLive[LANES];
+  alignas(32) u32 laneDone[LANES];
+  alignas(32) u32 laneHit[LANES];
+  size_t laneRay[LANES];
+  size_t nextRay = 0;
+
+  // Lanes without a ray left stay dead at the origin
+  auto takeRay = [&](size_t l) {
+    bool live = nextRay < count;
+    laneRay[l] = nextRay;
+    laneOx[l] = live ? origins[nextRay].x : 0.f;
+    laneOy[l] = live ? origins[nextRay].y : 0.f;
+    laneDx[l] = live ? directions[nextRay].x : 0.f;
+    laneDy[l] = live ? directions[nextRay].y : 0.f;
+    laneT[l] = 0.f;
+    laneSteps[l] = 0;
+    laneLive[l] = live ? ~0u : 0u;
+    nextRay += live;
+  };
+
+  for (size_t l = 0; l < LANES; l++)
+    takeRay(l);
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 fieldWidth = _mm256_set1_ps(static_cast<float>(width));
+  const __m256 fieldHeight = _mm256_set1_ps(static_cast<float>(height));
+  const __m256 maxT = _mm256_set1_ps(maxDist);
+  const __m256 hitT = _mm256_set1_ps(hitDst);
+  const __m256i rowPitch = _mm256_set1_epi32(static_cast<int>(width));
+  // Signed compare, maxSteps is far below 2^31
+  const __m256i stepLimit = _mm256_set1_epi32(static_cast<int>(maxSteps));
+
+  while (true) {
+    const __m256 ox = _mm256_load_ps(laneOx);
+    const __m256 oy = _mm256_load_ps(laneOy);
+    const __m256 dx = _mm256_load_ps(laneDx);
+    const __m256 dy = _mm256_load_ps(laneDy);
+    __m256 t = _mm256_load_ps(laneT);
+    __m256i steps = _mm256_load_si256(reinterpret_cast<const __m256i*>(laneSteps));
+    const __m256 live = _mm256_castsi256_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(laneLive)));
+
+    if (_mm256_movemask_ps(live) == 0)
+      break;
+
+    // Marches the lanes until one of them is done
+    __m256 done, hitNow;
+    do {
+      __m256 px = _mm256_add_ps(ox, _mm256_mul_ps(dx, t));
+      __m256 py = _mm256_add_ps(oy, _mm256_mul_ps(dy, t));
+
+      __m256 inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(px, zero, _CMP_GE_OQ), _mm256_cmp_ps(py, zero, _CMP_GE_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(px, fieldWidth, _CMP_LT_OQ), _mm256_cmp_ps(py, fieldHeight, _CMP_LT_OQ))
+      );
+      __m256 running = _mm256_and_ps(
+        _mm256_and_ps(live, inside),
+        _mm256_and_ps(_mm256_cmp_ps(t, maxT, _CMP_LT_OQ), _mm256_castsi256_ps(_mm256_cmpgt_epi32(stepLimit, steps)))
+      );
+
+      // Lanes that don't read use index 0, masked out anyway
+      __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(py), rowPitch), _mm256_cvttps_epi32(px));
+      index = _mm256_and_si256(index, _mm256_castps_si256(running));
+
+      __m256 dst = _mm256_mul_ps(_mm256_mask_i32gather_ps(zero, field, index, running, 4), fieldWidth);
+
+      // The all-ones mask is -1 as an integer
+      steps = _mm256_sub_epi32(steps, _mm256_castps_si256(running));
+
+      hitNow = _mm256_and_ps(running, _mm256_cmp_ps(dst, hitT, _CMP_LT_OQ));
+      done = _mm256_or_ps(_mm256_andnot_ps(running, live), hitNow);
+
+      t = _mm256_add_ps(t, _mm256_and_ps(_mm256_andnot_ps(hitNow, running), dst));
+    } while (_mm256_movemask_ps(done) == 0);
+
+    _mm256_store_ps(laneT, t);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneSteps), steps);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneDone), _mm256_castps_si256(done));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(laneHit), _mm256_castps_si256(hitNow));
+
+    for (size_t l = 0; l < LANES; l++) {
+      if (!laneDone[l])
+        continue;
+
+      Hit& result = hits[laneRay[l]];
+      result.distance = std::min(laneT[l], maxDist);
+      result.position = origins[laneRay[l]] + directions[laneRay[l]] * result.distance;
+      result.steps = laneSteps[l];
+      result.hit = laneHit[l] != 0;
+
+      takeRay(l);
+    }
+  }
+}
+
+#else
+
+void RayBatch::marchRange(const sf::Vector2f* origins, const sf::Vector2f* directions, size_t count, float maxDist, Hit* hits) const {
+  const float fieldWidth = static_cast<float>(width);
+
+  for (size_t l = 0; l < count; l++) {
+    Hit& result = hits[l];
+    result = {0.f, origins[l], 0, false};
+
+    float t = 0.f;
+    for (u32 i = 0; i < maxSteps && t < maxDist; i++) {
+      sf::Vector2f pos = origins[l] + directions[l] * t;
+      if (pos.x < 0.f || pos.y < 0.f || pos.x >= width || pos.y >= height)
+        break;
+
+      float dst = field[static_cast<size_t>(pos.y) * width + static_cast<size_t>(pos.x)] * fieldWidth;
+      result.steps++;
+
+      if (dst < hitDst) {
+        result.hit = true;
+        break;
+      }
+
+      t += dst;
+    }
+
+    result.distance = std::min(t, maxDist);
+    result.position = origins[l] + directions[l] * result.distance;
+  }
+}
+
+#endif
+
+void RayBatch::setHitDistance(float distance) {
+  hitDst = distance;
+}
+
+void RayBatch::setMaxSteps(u32 steps) {
+  maxSteps = steps;
+}
+
+size_t RayBatch::getLaneCount() {
+  return LANES;
+}
+
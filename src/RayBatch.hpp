@@ -0,0 +1,54 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "SDF_Format.hpp"
+#include "ThreadPool.hpp"
+
+// Visibility and line-of-sight queries: many rays sphere traced through the same field at once.
+// getLaneCount() rays are marched together (8 with AVX2 gathers, 1 otherwise), chunks of the batch are spread
+// over a thread pool and nothing is allocated while marching
+class RayBatch {
+public:
+  struct Hit {
+    float distance;        // Along the ray, to where it stopped
+    sf::Vector2f position;
+    u32 steps;             // Reads of the field
+    bool hit;              // Got closer than the hit distance before maxDist, the border or the step limit
+  };
+
+  explicit RayBatch(size_t threadCount = 0);
+
+  // Field to march, distance / width like the backends store it. R32F is read in place and has to outlive the
+  // queries, the other formats are converted into a float copy. To call again whenever the field changes
+  void setField(const u8* pixels, sdf::Format format, size_t width, size_t height);
+
+  // Rays from origins along the normalized directions (pixels), hits gets one entry per ray
+  void marchBatch(std::span<const sf::Vector2f> origins, std::span<const sf::Vector2f> directions, float maxDist, std::span<Hit> hits);
+
+  // In pixels, 1 by default
+  void setHitDistance(float distance);
+
+  // 256 by default
+  void setMaxSteps(u32 steps);
+
+  [[nodiscard]]
+  static size_t getLaneCount();
+
+private:
+  ThreadPool threadPool;
+
+  const float* field = nullptr;
+  std::vector<float> fieldCopy;
+  size_t width = 0;
+  size_t height = 0;
+
+  float hitDst = 1.f;
+  u32 maxSteps = 256;
+
+private:
+  // count rays, getLaneCount() at a time
+  void marchRange(const sf::Vector2f* origins, const sf::Vector2f* directions, size_t count, float maxDist, Hit* hits) const;
+};
+
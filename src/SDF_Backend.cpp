@@ -0,0 +1,294 @@
+#include "SDF_Backend.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+#include "CPU_SDF.hpp"
+#include "JFA_SDF.hpp"
+#include "MultiOCL_SDF.hpp"
+#include "OCL_SDF.hpp"
+#include "ShapeContainer.hpp"
+#include "utils/utils.hpp"
+
+// Covers the difference between the device and host float math in the tile test
+constexpr float TILE_TEST_MARGIN = 1.f;
+
+SDF_Backend::SDF_Backend(size_t width, size_t height, sdf::Format format)
+  : width(width),
+    height(height),
+    imageSize(width * height),
+    tilesX((width + TILE_SIZE - 1) / TILE_SIZE),
+    tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+    format(format),
+    pixels(new u8[width * height * sdf::pixelSize(format)]),
+    tileMaxDst(tilesX * tilesY, FLT_MAX),
+    binning(width, height, TILE_SIZE),
+    tileDirty(tilesX * tilesY, 0) {}
+
+SDF_Backend::~SDF_Backend() {
+  if (pixels) delete[] pixels;
+}
+
+void SDF_Backend::updateShapes(const ShapeContainer& shapes) {
+  if (sceneSynced && shapes.version == syncedVersion)
+    return;
+
+  waitIdle();
+
+  syncShapes(shapes.circles, shapes.circlesVersion, circles, sdf::toCircle, [this](size_t begin, size_t end) {
+    updateCirclesBuffer(begin, end);
+  });
+
+  syncShapes(shapes.rects, shapes.rectsVersion, rects, sdf::toRectangle, [this](size_t begin, size_t end) {
+    updateRectsBuffer(begin, end);
+  });
+
+  // Rarely edited, copied whole
+  if (!sceneSynced || shapes.programVersion != syncedProgramVersion) {
+    program = shapes.program;
+    if (scale != 1.f)
+      program.transform(scale, {sdf::fieldOffset(scale), sdf::fieldOffset(scale)});
+
+    updateProgramBuffer();
+    syncedProgramVersion = shapes.programVersion;
+    invalidatedAll = true;
+  }
+
+  sceneSynced = true;
+  syncedVersion = shapes.version;
+  needsRun = true;
+}
+
+void SDF_Backend::updateTables(const sdf::SceneTables& tables) {
+  waitIdle();
+
+  circles.assign(tables.circles.begin(), tables.circles.end());
+  rects.assign(tables.rects.begin(), tables.rects.end());
+  program.assign(tables.programWords, tables.programGroups, tables.programGroupBounds, tables.programColors);
+
+  if (scale != 1.f) {
+    for (Circle& circle : circles)
+      circle = sdf::toField(circle, scale);
+    for (Rectangle& rect : rects)
+      rect = sdf::toField(rect, scale);
+
+    program.transform(scale, {sdf::fieldOffset(scale), sdf::fieldOffset(scale)});
+  }
+
+  updateCirclesBuffer(0, circles.size());
+  updateRectsBuffer(0, rects.size());
+  updateProgramBuffer();
+
+  sceneSynced = false;
+  invalidate();
+}
+
+void SDF_Backend::setScale(float scale) {
+  if (scale == this->scale)
+    return;
+
+  // Tables from updateTables() are already in field pixels of the previous scale, this maps them over
+  waitIdle();
+  float ratio = scale / this->scale;
+  for (Circle& circle : circles)
+    circle = sdf::toField(circle, ratio);
+  for (Rectangle& rect : rects)
+    rect = sdf::toField(rect, ratio);
+  program.transform(ratio, {sdf::fieldOffset(ratio), sdf::fieldOffset(ratio)});
+
+  updateCirclesBuffer(0, circles.size());
+  updateRectsBuffer(0, rects.size());
+  updateProgramBuffer();
+
+  this->scale = scale;
+  sceneSynced = false;
+  invalidate();
+}
+
+float SDF_Backend::getScale() const {
+  return scale;
+}
+
+bool SDF_Backend::run() {
+  if (!needsRun)
+    return false;
+
+  waitIdle();
+
+  // Past half of the image the bookkeeping isn't worth it
+  if (invalidatedAll || dirtyTiles.size() * 2 > getTileCount()) {
+    dirtyTiles.resize(getTileCount());
+    std::iota(dirtyTiles.begin(), dirtyTiles.end(), 0u);
+  }
+
+  if (!dirtyTiles.empty()) {
+    if (binningEnabled)
+      binning.build(circles, rects, program, dirtyTiles);
+    else
+      binning.buildFullScan(dirtyTiles);
+
+    compute();
+
+    if (!pixelsOnDevice)
+      pixelsChanged = true;
+  }
+
+  computedTiles = dirtyTiles.size();
+
+  std::fill(tileDirty.begin(), tileDirty.end(), 0);
+  dirtyTiles.clear();
+  invalidatedAll = false;
+  needsRun = false;
+
+  return computedTiles > 0;
+}
+
+void SDF_Backend::invalidate() {
+  invalidatedAll = true;
+  needsRun = true;
+}
+
+bool SDF_Backend::usesSeeds() const {
+  return false;
+}
+
+void SDF_Backend::updateSeeds(const sf::Image&) {}
+
+const u8* SDF_Backend::getPixels(Fetch fetch) {
+  if (pixelsOnDevice)
+    readPixels(fetch);
+
+  return pixels;
+}
+
+bool SDF_Backend::fetchPixels(Fetch fetch) {
+  if (pixelsOnDevice)
+    readPixels(fetch);
+
+  bool changed = pixelsChanged;
+  pixelsChanged = false;
+
+  return changed;
+}
+
+bool SDF_Backend::shareTexture(const sf::Texture&) {
+  return false;
+}
+
+bool SDF_Backend::setPipelineDepth(size_t) {
+  return false;
+}
+
+SDF_Backend::DeviceTimes SDF_Backend::takeDeviceTimes() {
+  return {};
+}
+
+void SDF_Backend::updateProgramBuffer() {}
+
+void SDF_Backend::readPixels(Fetch) {}
+
+void SDF_Backend::waitIdle() {}
+
+size_t SDF_Backend::getComputedTileCount() const {
+  return computedTiles;
+}
+
+size_t SDF_Backend::getTileCount() const {
+  return tilesX * tilesY;
+}
+
+sdf::Format SDF_Backend::getFormat() const {
+  return format;
+}
+
+void SDF_Backend::setBinning(bool enabled) {
+  binningEnabled = enabled;
+}
+
+const TileBinning& SDF_Backend::getBinning() const {
+  return binning;
+}
+
+std::unique_ptr<SDF_Backend> SDF_Backend::create(size_t width, size_t height, Type type, sdf::Format format, bool printInfo) {
+  if (type == Type::Auto)
+    type = OCL_SDF::isAvailable() ? Type::OpenCL : Type::CPU;
+
+  switch (type) {
+    case Type::OpenCL:
+      if (!OCL_SDF::isAvailable())
+        error("No OpenCL GPU found for the OpenCL backend");
+      return std::make_unique<OCL_SDF>(width, height, format, printInfo);
+    case Type::JumpFlood:
+      return std::make_unique<JFA_SDF>(width, height, OCL_SDF::isAvailable(), format, printInfo);
+    case Type::MultiDevice:
+      if (!MultiOCL_SDF::isAvailable())
+        error("No OpenCL device found for the multi-device backend");
+      return std::make_unique<MultiOCL_SDF>(width, height, format, printInfo);
+    default:
+      return std::make_unique<CPU_SDF>(width, height, format);
+  }
+}
+
+template<typename SfShape, typename Shape, typename UploadFn>
+void SDF_Backend::syncShapes(const std::vector<SfShape>& src, const std::vector<u64>& versions, std::vector<Shape>& dst, Shape (*toShape)(const SfShape&), UploadFn upload) {
+  if (!sceneSynced || src.size() != dst.size()) {
+    dst.resize(src.size());
+    for (size_t i = 0; i < src.size(); i++)
+      dst[i] = sdf::toField(toShape(src[i]), scale);
+
+    upload(0, dst.size());
+    invalidatedAll = true;
+    return;
+  }
+
+  for (size_t i = 0; i < src.size(); i++) {
+    if (versions[i] <= syncedVersion)
+      continue;
+
+    size_t begin = i;
+    for (; i < src.size() && versions[i] > syncedVersion; i++) {
+      Shape moved = sdf::toField(toShape(src[i]), scale);
+
+      // Where it was and where it is now
+      if (!invalidatedAll) {
+        invalidateTiles(dst[i]);
+        invalidateTiles(moved);
+      }
+
+      dst[i] = moved;
+    }
+
+    upload(begin, i);
+  }
+}
+
+template<typename Shape>
+void SDF_Backend::invalidateTiles(const Shape& shape) {
+  for (size_t ty = 0; ty < tilesY; ty++) {
+    for (size_t tx = 0; tx < tilesX; tx++) {
+      size_t tile = ty * tilesX + tx;
+      if (tileDirty[tile])
+        continue;
+
+      // First and last pixel of the tile
+      float x0 = tx * TILE_SIZE;
+      float y0 = ty * TILE_SIZE;
+      float x1 = std::min((tx + 1) * TILE_SIZE, width) - 1;
+      float y1 = std::min((ty + 1) * TILE_SIZE, height) - 1;
+
+      // A distance field changes by at most the travelled distance, so nothing inside
+      // the tile is closer to the shape than its center minus half of the diagonal
+      sf::Vector2f center{(x0 + x1) * 0.5f, (y0 + y1) * 0.5f};
+      float halfDiagonal = std::hypot(x1 - x0, y1 - y0) * 0.5f;
+      float minShapeDst = sdf::signedDst(center, shape) - halfDiagonal;
+
+      if (minShapeDst <= tileMaxDst[tile] + TILE_TEST_MARGIN) {
+        tileDirty[tile] = 1;
+        dirtyTiles.push_back(tile);
+      }
+    }
+  }
+}
+
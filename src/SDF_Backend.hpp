@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "SDF_Format.hpp"
+#include "SDF_Scene.hpp"
+#include "SDF_Shapes.hpp"
+#include "TileBinning.hpp"
+#include "utils/types.hpp"
+
+struct ShapeContainer;
+
+// Common interface of the SDF generators. Every backend fills the same buffer (distance / width
+// stored as sdf::Format, see SDF_Format.hpp) so the consumers don't care who produced it.
+//
+// The field can cover the scene at a lower resolution than the scene's own (see setScale()), the shapes are
+// mapped to field pixels when they are synced. Distances are normalized by the field width either way, so the
+// stored values don't depend on the scale.
+//
+// The image is split into TILE_SIZE x TILE_SIZE tiles. When only some shapes move, only the tiles where
+// a moved shape was or becomes the closest one are evaluated again, the rest of the field is kept
+class SDF_Backend {
+public:
+  enum class Type {
+    Auto,   // OpenCL if a GPU is present, CPU otherwise
+    OpenCL,
+    CPU,
+    JumpFlood,  // Works on the rendered scene (see JFA_SDF), OpenCL if a GPU is present
+    MultiDevice // OpenCL split across every device found (see MultiOCL_SDF)
+  };
+
+  // What getPixels()/fetchPixels() wait for when the backend is pipelined
+  enum class Fetch {
+    Exact,      // The field of the last run()
+    LatestReady // Whatever the device has finished, possibly a few runs behind
+  };
+
+  static constexpr size_t TILE_SIZE = 16;
+
+  SDF_Backend(size_t width, size_t height, sdf::Format format);
+  virtual ~SDF_Backend();
+
+  // Uploads only the shapes changed since the previous call
+  void updateShapes(const ShapeContainer& shapes);
+
+  // Replaces the whole scene with tables already in the device layout (e.g. a mapped sdf::SceneFile),
+  // copied and uploaded as they are. The next updateShapes() starts over
+  void updateTables(const sdf::SceneTables& tables);
+
+  // Field pixels per scene pixel, the field then covers a scene of width / scale x height / scale.
+  // 1 by default. The whole scene is synced and evaluated again
+  void setScale(float scale);
+
+  [[nodiscard]]
+  float getScale() const;
+
+  // Recomputes the tiles affected by the uploaded changes. Returns whether anything was recomputed
+  bool run();
+
+  // The next run() evaluates the whole image
+  void invalidate();
+
+  // Whether the engine needs the rendered scene through updateSeeds() rather than the shapes
+  [[nodiscard]]
+  virtual bool usesSeeds() const;
+
+  virtual void updateSeeds(const sf::Image& scene);
+
+  // CPU copy of the field, read back first when the backend kept it on the device
+  [[nodiscard]]
+  const u8* getPixels(Fetch fetch = Fetch::Exact);
+
+  // Same as getPixels(), returns whether the CPU copy changed since the previous fetchPixels()
+  bool fetchPixels(Fetch fetch = Fetch::Exact);
+
+  // Makes run() write straight into the texture (same size and format). Returns false when the backend can't,
+  // the caller then keeps uploading getPixels()
+  virtual bool shareTexture(const sf::Texture& texture);
+
+  // Up to depth runs in flight: run() only submits the work and the results come back through fetchPixels().
+  // 0 = synchronous (default). Returns false when the backend is always synchronous
+  virtual bool setPipelineDepth(size_t depth);
+
+  // Device time of the latest run, in ms, reported once as soon as it's done.
+  // Zero when it isn't done, was already reported or the backend has nothing to report.
+  // The starts are on the host clock, placed from the device's own timestamps
+  struct DeviceTimes {
+    double kernel = 0.;
+    double readback = 0.;
+    std::chrono::steady_clock::time_point kernelStart;
+    std::chrono::steady_clock::time_point readbackStart;
+  };
+
+  [[nodiscard]]
+  virtual DeviceTimes takeDeviceTimes();
+
+  // Tiles evaluated by the last run()
+  [[nodiscard]]
+  size_t getComputedTileCount() const;
+
+  [[nodiscard]]
+  size_t getTileCount() const;
+
+  [[nodiscard]]
+  sdf::Format getFormat() const;
+
+  // Per-tile shape lists (on by default). Off makes every tile evaluate every shape
+  void setBinning(bool enabled);
+
+  [[nodiscard]]
+  const TileBinning& getBinning() const;
+
+  [[nodiscard]]
+  virtual const char* getName() const = 0;
+
+  [[nodiscard]]
+  static std::unique_ptr<SDF_Backend> create(size_t width, size_t height, Type type = Type::Auto, sdf::Format format = sdf::Format::RGBA8, bool printInfo = false);
+
+protected:
+  const size_t width, height;
+  const size_t imageSize;
+  const size_t tilesX, tilesY;
+  const sdf::Format format;
+  u8* pixels = nullptr;
+
+  using Circle = sdf::Circle;
+  using Rectangle = sdf::Rectangle;
+
+  // Host copy of the scene in field pixels, backends upload from here. Only the geometry: the colors are separate
+  // tables (see res/cl/ShapeLayout.h) and the distance doesn't need them
+  std::vector<Circle> circles;
+  std::vector<Rectangle> rects;
+  sdf::ShapeProgram program;
+
+  // Largest distance inside every tile, written by the backend for each tile it evaluates
+  std::vector<float> tileMaxDst;
+
+  // Tiles to evaluate and the shapes of each
+  TileBinning binning;
+
+  // compute() left the latest field only on the device, getPixels() calls readPixels() first
+  bool pixelsOnDevice = false;
+
+  // Set when pixels get new content, reset by fetchPixels()
+  bool pixelsChanged = false;
+
+  // circles/rects in [begin, end) were changed. When the count differs from the previous call the buffer has to be rebuilt.
+  // Called only while the backend is idle (after waitIdle())
+  virtual void updateCirclesBuffer(size_t begin, size_t end) = 0;
+  virtual void updateRectsBuffer(size_t begin, size_t end) = 0;
+  // program was replaced, the whole image is evaluated by the next run
+  virtual void updateProgramBuffer();
+
+  // Evaluates binning.getTiles() (index = tileY * tilesX + tileX, masked with TileBinning::FULL_SCAN_BIT) into pixels and tileMaxDst
+  virtual void compute() = 0;
+
+  // Copies what arrived into pixels (all of it with Fetch::Exact), sets pixelsChanged and
+  // clears pixelsOnDevice once nothing is left on the device
+  virtual void readPixels(Fetch fetch);
+
+  // Blocks until the device is done with the host copies (shapes, binning, tileMaxDst).
+  // Called before the base touches them
+  virtual void waitIdle();
+
+private:
+  float scale = 1.f;
+  bool sceneSynced = false;
+  u64 syncedVersion = 0;
+  u64 syncedProgramVersion = 0;
+  bool needsRun = false;
+
+  bool binningEnabled = true;
+  bool invalidatedAll = false;
+  std::vector<u8> tileDirty;
+  std::vector<u32> dirtyTiles;
+  size_t computedTiles = 0;
+
+private:
+  // Converts and uploads every run of consecutive shapes newer than syncedVersion
+  template<typename SfShape, typename Shape, typename UploadFn>
+  void syncShapes(const std::vector<SfShape>& src, const std::vector<u64>& versions, std::vector<Shape>& dst, Shape (*toShape)(const SfShape&), UploadFn upload);
+
+  // Marks the tiles where the shape can be the closest one
+  template<typename Shape>
+  void invalidateTiles(const Shape& shape);
+};
+
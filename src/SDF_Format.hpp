@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__F16C__)
+  #include <immintrin.h>
+#endif
+
+#include "CL/cl.h"
+#include "utils/types.hpp"
+
+namespace sdf {
+
+// Storage of the field. Every format holds distance / width in its first channel, the device does the conversion
+enum class Format {
+  RGBA8, // Unsigned, clamped to [0, 1] and copied to R, G and B. 256 levels over the width
+  R8,    // Signed normalized, [-1, 1] in 127 steps each side
+  R16F,  // Half float, signed
+  R32F   // Float, signed
+};
+
+[[nodiscard]]
+inline size_t pixelSize(Format format) {
+  switch (format) {
+    case Format::RGBA8: return 4;
+    case Format::R8:    return 1;
+    case Format::R16F:  return 2;
+    case Format::R32F:  return 4;
+  }
+
+  return 4;
+}
+
+[[nodiscard]]
+inline const char* formatName(Format format) {
+  switch (format) {
+    case Format::RGBA8: return "RGBA8";
+    case Format::R8:    return "R8";
+    case Format::R16F:  return "R16F";
+    case Format::R32F:  return "R32F";
+  }
+
+  return "?";
+}
+
+[[nodiscard]]
+inline cl_image_format clImageFormat(Format format) {
+  switch (format) {
+    case Format::R8:   return {CL_R, CL_SNORM_INT8};
+    case Format::R16F: return {CL_R, CL_HALF_FLOAT};
+    case Format::R32F: return {CL_R, CL_FLOAT};
+    default:           return {CL_RGBA, CL_UNORM_INT8};
+  }
+}
+
+// IEEE half, rounded to nearest
+[[nodiscard]]
+inline u16 toHalf(float value) {
+#if defined(__F16C__)
+  return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+  u32 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  u32 sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+  u32 mantissa = bits & 0x7FFFFF;
+
+  // NaN stays NaN, the rest saturates to infinity
+  if (((bits >> 23) & 0xFF) == 0xFF)
+    return static_cast<u16>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+  if (exponent >= 31)
+    return static_cast<u16>(sign | 0x7C00);
+
+  // Subnormal or zero
+  if (exponent <= 0) {
+    if (exponent < -10)
+      return static_cast<u16>(sign);
+
+    mantissa |= 0x800000;
+    u32 shift = static_cast<u32>(14 - exponent);
+    u32 half = mantissa >> shift;
+    u32 rest = mantissa & ((1u << shift) - 1);
+    u32 halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1)))
+      half++;
+
+    return static_cast<u16>(sign | half);
+  }
+
+  u32 half = sign | (static_cast<u32>(exponent) << 10) | (mantissa >> 13);
+  u32 rest = mantissa & 0x1FFF;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    half++; // Carries into the exponent when needed
+
+  return static_cast<u16>(half);
+#endif
+}
+
+[[nodiscard]]
+inline float fromHalf(u16 half) {
+  u32 sign = static_cast<u32>(half & 0x8000) << 16;
+  u32 exponent = (half >> 10) & 0x1F;
+  u32 mantissa = half & 0x3FF;
+
+  if (exponent == 0) {
+    float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  }
+
+  u32 bits = sign | ((exponent == 31 ? 0xFF : exponent - 15 + 127) << 23) | (mantissa << 13);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// What write_imagef does with the format
+inline void store(Format format, u8* pixels, size_t index, float value) {
+  switch (format) {
+    case Format::RGBA8: {
+      u8 col = static_cast<u8>(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+      u8* out = pixels + index * 4;
+      out[0] = col;
+      out[1] = col;
+      out[2] = col;
+      out[3] = 255;
+      break;
+    }
+    case Format::R8: {
+      int8_t snorm = static_cast<int8_t>(std::floor(std::clamp(value, -1.f, 1.f) * 127.f + 0.5f));
+      std::memcpy(pixels + index, &snorm, 1);
+      break;
+    }
+    case Format::R16F: {
+      u16 half = toHalf(value);
+      std::memcpy(pixels + index * 2, &half, 2);
+      break;
+    }
+    case Format::R32F:
+      std::memcpy(pixels + index * 4, &value, 4);
+      break;
+  }
+}
+
+// distance / width of the pixel
+[[nodiscard]]
+inline float load(Format format, const u8* pixels, size_t index) {
+  switch (format) {
+    case Format::RGBA8:
+      return pixels[index * 4] / 255.f;
+    case Format::R8: {
+      int8_t snorm;
+      std::memcpy(&snorm, pixels + index, 1);
+      return std::max(snorm / 127.f, -1.f);
+    }
+    case Format::R16F: {
+      u16 half;
+      std::memcpy(&half, pixels + index * 2, 2);
+      return fromHalf(half);
+    }
+    case Format::R32F: {
+      float value;
+      std::memcpy(&value, pixels + index * 4, 4);
+      return value;
+    }
+  }
+
+  return 0.f;
+}
+
+} // namespace sdf
+
@@ -0,0 +1,424 @@
+#include "SDF_Program.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <numbers>
+
+#include "SDF_Shapes.hpp"
+
+// Same as the smallest circles of ShapeContainer
+constexpr size_t CIRCLE_POINTS = 30;
+
+static float dot(sf::Vector2f a, sf::Vector2f b) {
+  return a.x * b.x + a.y * b.y;
+}
+
+static u32 opOf(const cl_float4& header) {
+  return std::bit_cast<u32>(header.s[0]);
+}
+
+static float smoothUnion(float a, float b, float k) {
+  if (k <= 0.f)
+    return std::min(a, b);
+
+  float h = std::max(k - std::fabs(a - b), 0.f) / k;
+  return std::min(a, b) - h * h * k * 0.25f;
+}
+
+// Inigo Quilez's polygon distance: closest edge, sign from the crossings of a horizontal line
+static float signedDstToPolygon(sf::Vector2f point, const cl_float4* vertexWords, u32 count) {
+  auto vertex = [&](u32 i) {
+    const cl_float4& word = vertexWords[i / 2];
+    return i & 1 ? sf::Vector2f{word.s[2], word.s[3]} : sf::Vector2f{word.s[0], word.s[1]};
+  };
+
+  float dst = dot(point - vertex(0), point - vertex(0));
+  float sign = 1.f;
+
+  for (u32 i = 0, j = count - 1; i < count; j = i, i++) {
+    sf::Vector2f vi = vertex(i);
+    sf::Vector2f vj = vertex(j);
+    sf::Vector2f edge = vj - vi;
+    sf::Vector2f w = point - vi;
+    sf::Vector2f b = w - edge * std::clamp(dot(w, edge) / std::max(dot(edge, edge), 1e-12f), 0.f, 1.f);
+    dst = std::min(dst, dot(b, b));
+
+    bool above = point.y >= vi.y;
+    bool below = point.y < vj.y;
+    bool left = edge.x * w.y > edge.y * w.x;
+    if ((above && below && left) || (!above && !below && !left))
+      sign = -sign;
+  }
+
+  return sign * std::sqrt(dst);
+}
+
+static void appendQuad(std::vector<sf::Vertex>& vertices, sf::Vector2f a, sf::Vector2f b, sf::Vector2f c, sf::Vector2f d, sf::Color color) {
+  for (sf::Vector2f corner : {a, b, c, a, c, d})
+    vertices.push_back({corner, color, {}});
+}
+
+static void appendFan(std::vector<sf::Vertex>& vertices, sf::Vector2f center, float radius, sf::Color color) {
+  sf::Vector2f prev = center + sf::Vector2f{radius, 0.f};
+
+  for (size_t i = 1; i <= CIRCLE_POINTS; i++) {
+    float angle = 2.f * std::numbers::pi_v<float> * i / CIRCLE_POINTS;
+    sf::Vector2f next = center + sf::Vector2f{std::cos(angle), std::sin(angle)} * radius;
+
+    vertices.push_back({center, color, {}});
+    vertices.push_back({prev, color, {}});
+    vertices.push_back({next, color, {}});
+    prev = next;
+  }
+}
+
+namespace sdf {
+
+void ShapeProgram::clear() {
+  words.clear();
+  groups.clear();
+  groupBounds.clear();
+  colors.clear();
+  inGroup = false;
+  smoothness = 0.f;
+}
+
+void ShapeProgram::beginGroup(float smoothness) {
+  assert(!inGroup);
+
+  inGroup = true;
+  this->smoothness = std::max(smoothness, 0.f);
+
+  u32 first = static_cast<u32>(words.size());
+  groups.push_back({first, first});
+  groupBounds.push_back({{FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX}});
+}
+
+void ShapeProgram::endGroup() {
+  assert(inGroup);
+
+  // Nothing to evaluate
+  if (groups.back().first == words.size()) {
+    groups.pop_back();
+    groupBounds.pop_back();
+  } else {
+    float grow = smoothness * 0.25f;
+    cl_float4& bounds = groupBounds.back();
+    groups.back().end = static_cast<u32>(words.size());
+    bounds = {{bounds.s[0] - grow, bounds.s[1] - grow, bounds.s[2] + grow, bounds.s[3] + grow}};
+  }
+
+  inGroup = false;
+  smoothness = 0.f;
+}
+
+void ShapeProgram::addCircle(sf::Vector2f center, float radius, sf::Color color) {
+  bool ownGroup = beginShape();
+
+  pushHeader(SHAPE_OP_CIRCLE, center.x, center.y);
+  words.push_back({{radius, 0.f, 0.f, 0.f}});
+
+  sf::Vector2f ext{radius, radius};
+  endShape(ownGroup, center - ext, center + ext, color);
+}
+
+void ShapeProgram::addBox(sf::Vector2f center, sf::Vector2f halfSize, float angle, sf::Color color) {
+  bool ownGroup = beginShape();
+  float c = std::cos(angle);
+  float s = std::sin(angle);
+
+  pushHeader(SHAPE_OP_BOX, center.x, center.y);
+  words.push_back({{halfSize.x, halfSize.y, c, s}});
+
+  sf::Vector2f ext{
+    std::fabs(c) * halfSize.x + std::fabs(s) * halfSize.y,
+    std::fabs(s) * halfSize.x + std::fabs(c) * halfSize.y
+  };
+  endShape(ownGroup, center - ext, center + ext, color);
+}
+
+void ShapeProgram::addCapsule(sf::Vector2f a, sf::Vector2f b, float radius, sf::Color color) {
+  bool ownGroup = beginShape();
+
+  pushHeader(SHAPE_OP_CAPSULE, a.x, a.y);
+  words.push_back({{b.x, b.y, radius, 0.f}});
+
+  sf::Vector2f ext{radius, radius};
+  sf::Vector2f min{std::min(a.x, b.x), std::min(a.y, b.y)};
+  sf::Vector2f max{std::max(a.x, b.x), std::max(a.y, b.y)};
+  endShape(ownGroup, min - ext, max + ext, color);
+}
+
+void ShapeProgram::addSegment(sf::Vector2f a, sf::Vector2f b, sf::Color color) {
+  addCapsule(a, b, 0.f, color);
+}
+
+void ShapeProgram::addPolygon(std::span<const sf::Vector2f> points, sf::Color color) {
+  assert(points.size() >= 3);
+
+  bool ownGroup = beginShape();
+  u32 count = static_cast<u32>(points.size());
+
+  pushHeader(SHAPE_OP_POLYGON, std::bit_cast<float>(count), 0.f);
+
+  sf::Vector2f min{FLT_MAX, FLT_MAX};
+  sf::Vector2f max{-FLT_MAX, -FLT_MAX};
+
+  for (u32 i = 0; i < count; i += 2) {
+    sf::Vector2f second = i + 1 < count ? points[i + 1] : points[i];
+    words.push_back({{points[i].x, points[i].y, second.x, second.y}});
+  }
+
+  for (sf::Vector2f point : points) {
+    min = {std::min(min.x, point.x), std::min(min.y, point.y)};
+    max = {std::max(max.x, point.x), std::max(max.y, point.y)};
+  }
+
+  endShape(ownGroup, min, max, color);
+}
+
+float ShapeProgram::signedDst(sf::Vector2f point, size_t group) const {
+  float dst = FLT_MAX;
+
+  for (u32 w = groups[group].first; w < groups[group].end;) {
+    const cl_float4& header = words[w];
+    u32 op = opOf(header);
+    sf::Vector2f first{header.s[2], header.s[3]};
+    float shapeDst;
+
+    if (op == SHAPE_OP_POLYGON) {
+      u32 count = std::bit_cast<u32>(header.s[2]);
+      shapeDst = signedDstToPolygon(point, &words[w + 1], count);
+      w += 1 + (count + 1) / 2;
+    } else {
+      const cl_float4& params = words[w + 1];
+
+      if (op == SHAPE_OP_CIRCLE) {
+        shapeDst = std::sqrt(dot(point - first, point - first)) - params.s[0];
+      } else if (op == SHAPE_OP_BOX) {
+        // Into the box's frame, rotated back
+        sf::Vector2f v = point - first;
+        sf::Vector2f local{v.x * params.s[2] + v.y * params.s[3], -v.x * params.s[3] + v.y * params.s[2]};
+        Rectangle box{{{0.f, 0.f}}, {{params.s[0], params.s[1]}}};
+        shapeDst = sdf::signedDst(local, box);
+      } else {
+        sf::Vector2f pa = point - first;
+        sf::Vector2f ba = sf::Vector2f{params.s[0], params.s[1]} - first;
+        float h = std::clamp(dot(pa, ba) / std::max(dot(ba, ba), 1e-12f), 0.f, 1.f);
+        sf::Vector2f closest = pa - ba * h;
+        shapeDst = std::sqrt(dot(closest, closest)) - params.s[2];
+      }
+
+      w += 2;
+    }
+
+    dst = smoothUnion(dst, shapeDst, header.s[1]);
+  }
+
+  return dst;
+}
+
+void ShapeProgram::assign(std::span<const cl_float4> words, std::span<const ShapeGroup> groups, std::span<const cl_float4> groupBounds, std::span<const sf::Color> colors) {
+  assert(groups.size() == groupBounds.size());
+
+  clear();
+  this->words.assign(words.begin(), words.end());
+  this->groups.assign(groups.begin(), groups.end());
+  this->groupBounds.assign(groupBounds.begin(), groupBounds.end());
+  this->colors.assign(colors.begin(), colors.end());
+}
+
+void ShapeProgram::transform(float scale, sf::Vector2f offset) {
+  auto point = [&](float& x, float& y) {
+    x = x * scale + offset.x;
+    y = y * scale + offset.y;
+  };
+
+  for (u32 w = 0; w < words.size();) {
+    cl_float4& header = words[w];
+    u32 op = opOf(header);
+    header.s[1] *= scale;
+
+    if (op == SHAPE_OP_POLYGON) {
+      u32 count = std::bit_cast<u32>(header.s[2]);
+      for (u32 i = 0; i < count; i++) {
+        cl_float4& word = words[w + 1 + i / 2];
+        if (i & 1)
+          point(word.s[2], word.s[3]);
+        else
+          point(word.s[0], word.s[1]);
+      }
+
+      // The padding vertex of an odd count repeats the last one
+      if (count & 1) {
+        cl_float4& last = words[w + 1 + count / 2];
+        last.s[2] = last.s[0];
+        last.s[3] = last.s[1];
+      }
+
+      w += 1 + (count + 1) / 2;
+      continue;
+    }
+
+    cl_float4& params = words[w + 1];
+    point(header.s[2], header.s[3]);
+
+    if (op == SHAPE_OP_CIRCLE) {
+      params.s[0] *= scale;
+    } else if (op == SHAPE_OP_BOX) {
+      // The rotation stays
+      params.s[0] *= scale;
+      params.s[1] *= scale;
+    } else {
+      point(params.s[0], params.s[1]);
+      params.s[2] *= scale;
+    }
+
+    w += 2;
+  }
+
+  for (cl_float4& bounds : groupBounds) {
+    point(bounds.s[0], bounds.s[1]);
+    point(bounds.s[2], bounds.s[3]);
+  }
+}
+
+void ShapeProgram::writeText(std::ostream& out) const {
+  size_t shape = 0;
+
+  for (const ShapeGroup& group : groups) {
+    // A lone shape is a group of its own anyway, circles only go to the program inside one
+    const cl_float4& firstHeader = words[group.first];
+    u32 firstSize = opOf(firstHeader) == SHAPE_OP_POLYGON ? 1 + (std::bit_cast<u32>(firstHeader.s[2]) + 1) / 2 : 2;
+    bool explicitGroup = group.first + firstSize != group.end || firstHeader.s[1] > 0.f || opOf(firstHeader) == SHAPE_OP_CIRCLE;
+
+    if (explicitGroup)
+      out << "smooth " << firstHeader.s[1] << '\n';
+
+    for (u32 w = group.first; w < group.end; shape++) {
+      const cl_float4& header = words[w];
+      const cl_float4& params = words[w + 1];
+      sf::Color color = colors[shape];
+
+      switch (opOf(header)) {
+        case SHAPE_OP_CIRCLE:
+          out << "circle " << header.s[2] - params.s[0] << ' ' << header.s[3] - params.s[0] << ' ' << params.s[0];
+          w += 2;
+          break;
+        case SHAPE_OP_BOX:
+          out << "box " << header.s[2] << ' ' << header.s[3] << ' ' << params.s[0] << ' ' << params.s[1] << ' '
+              << std::atan2(params.s[3], params.s[2]) * 180.f / std::numbers::pi_v<float>;
+          w += 2;
+          break;
+        case SHAPE_OP_CAPSULE:
+          out << "capsule " << header.s[2] << ' ' << header.s[3] << ' ' << params.s[0] << ' ' << params.s[1] << ' ' << params.s[2];
+          w += 2;
+          break;
+        default: {
+          u32 count = std::bit_cast<u32>(header.s[2]);
+          out << "polygon " << count;
+          for (u32 i = 0; i < count; i++) {
+            const cl_float4& word = words[w + 1 + i / 2];
+            out << ' ' << word.s[i & 1 ? 2 : 0] << ' ' << word.s[i & 1 ? 3 : 1];
+          }
+          w += 1 + (count + 1) / 2;
+        }
+      }
+
+      out << ' ' << int(color.r) << ' ' << int(color.g) << ' ' << int(color.b) << '\n';
+    }
+
+    if (explicitGroup)
+      out << "end\n";
+  }
+}
+
+ShapeProgram::GroupRef ShapeProgram::group(size_t index) const {
+  const cl_float4& bounds = groupBounds[index];
+  sf::Vector2f min{bounds.s[0], bounds.s[1]};
+  sf::Vector2f max{bounds.s[2], bounds.s[3]};
+  return {this, static_cast<u32>(index), (min + max) * 0.5f, (max - min) * 0.5f};
+}
+
+void ShapeProgram::appendTriangles(std::vector<sf::Vertex>& vertices) const {
+  size_t shape = 0;
+
+  for (u32 w = 0; w < words.size(); shape++) {
+    const cl_float4& header = words[w];
+    u32 op = opOf(header);
+    sf::Color color = colors[shape];
+    sf::Vector2f first{header.s[2], header.s[3]};
+
+    if (op == SHAPE_OP_POLYGON) {
+      u32 count = std::bit_cast<u32>(header.s[2]);
+      auto vertex = [&](u32 i) {
+        const cl_float4& word = words[w + 1 + i / 2];
+        return i & 1 ? sf::Vector2f{word.s[2], word.s[3]} : sf::Vector2f{word.s[0], word.s[1]};
+      };
+
+      for (u32 i = 1; i + 1 < count; i++) {
+        vertices.push_back({vertex(0), color, {}});
+        vertices.push_back({vertex(i), color, {}});
+        vertices.push_back({vertex(i + 1), color, {}});
+      }
+
+      w += 1 + (count + 1) / 2;
+      continue;
+    }
+
+    const cl_float4& params = words[w + 1];
+    w += 2;
+
+    if (op == SHAPE_OP_CIRCLE) {
+      appendFan(vertices, first, params.s[0], color);
+    } else if (op == SHAPE_OP_BOX) {
+      sf::Vector2f axisX = sf::Vector2f{params.s[2], params.s[3]} * params.s[0];
+      sf::Vector2f axisY = sf::Vector2f{-params.s[3], params.s[2]} * params.s[1];
+      appendQuad(vertices, first - axisX - axisY, first + axisX - axisY, first + axisX + axisY, first - axisX + axisY, color);
+    } else {
+      sf::Vector2f second{params.s[0], params.s[1]};
+      float radius = params.s[2];
+      sf::Vector2f along = second - first;
+      float length = std::sqrt(dot(along, along));
+
+      // Segments stay a pixel wide
+      if (length > 0.f) {
+        sf::Vector2f normal = sf::Vector2f{-along.y, along.x} / length * std::max(radius, 0.5f);
+        appendQuad(vertices, first - normal, second - normal, second + normal, first + normal, color);
+      }
+
+      if (radius > 0.f) {
+        appendFan(vertices, first, radius, color);
+        appendFan(vertices, second, radius, color);
+      }
+    }
+  }
+}
+
+bool ShapeProgram::beginShape() {
+  if (inGroup)
+    return false;
+
+  beginGroup(0.f);
+  return true;
+}
+
+void ShapeProgram::endShape(bool ownGroup, sf::Vector2f min, sf::Vector2f max, sf::Color color) {
+  colors.push_back(color);
+
+  cl_float4& bounds = groupBounds.back();
+  bounds = {{std::min(bounds.s[0], min.x), std::min(bounds.s[1], min.y), std::max(bounds.s[2], max.x), std::max(bounds.s[3], max.y)}};
+
+  if (ownGroup)
+    endGroup();
+}
+
+void ShapeProgram::pushHeader(u32 op, float z, float w) {
+  words.push_back({{std::bit_cast<float>(op), smoothness, z, w}});
+}
+
+} // namespace sdf
+
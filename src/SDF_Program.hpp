@@ -0,0 +1,105 @@
+#pragma once
+
+#include <ostream>
+#include <span>
+#include <vector>
+
+#include "ShapeLayout.h"
+#include "utils/types.hpp"
+
+namespace sdf {
+
+// Rotated boxes, capsules, line segments, polygons and circles compiled into the words of res/cl/ShapeLayout.h,
+// interpreted by one kernel (res/cl/SDF.cl) and by the CPU backend. Shapes added between beginGroup() and endGroup()
+// blend with a smooth union, any other shape is a group of its own. The groups are what the tiles are binned by:
+// their boxes are grown by a quarter of the smoothness, the most a smooth union takes off the distance
+class ShapeProgram {
+public:
+  void clear();
+
+  // The shapes until endGroup() blend with a smooth union of that radius (pixels), 0 is a hard union
+  void beginGroup(float smoothness);
+  void endGroup();
+
+  void addCircle(sf::Vector2f center, float radius, sf::Color color);
+  // angle in radians, clockwise like sf::Transformable::setRotation
+  void addBox(sf::Vector2f center, sf::Vector2f halfSize, float angle, sf::Color color);
+  void addCapsule(sf::Vector2f a, sf::Vector2f b, float radius, sf::Color color);
+  void addSegment(sf::Vector2f a, sf::Vector2f b, sf::Color color);
+  // Closed, either winding, at least 3 points
+  void addPolygon(std::span<const sf::Vector2f> points, sf::Color color);
+
+  // Takes the tables of another program as they are (see the getters, e.g. from a scene file)
+  void assign(std::span<const cl_float4> words, std::span<const ShapeGroup> groups, std::span<const cl_float4> groupBounds, std::span<const sf::Color> colors);
+
+  // Maps every point to point * scale + offset, the lengths and smoothness to length * scale
+  void transform(float scale, sf::Vector2f offset);
+
+  // The lines ShapeContainer::load reads back into the same program
+  void writeText(std::ostream& out) const;
+
+  [[nodiscard]]
+  size_t getGroupCount() const { return groups.size(); }
+
+  [[nodiscard]]
+  const std::vector<cl_float4>& getWords() const { return words; }
+
+  [[nodiscard]]
+  const std::vector<ShapeGroup>& getGroups() const { return groups; }
+
+  // .xy = min, .zw = max of every group
+  [[nodiscard]]
+  const std::vector<cl_float4>& getGroupBounds() const { return groupBounds; }
+
+  // Of every shape in the order of the words
+  [[nodiscard]]
+  const std::vector<sf::Color>& getColors() const { return colors; }
+
+  // Host version of signedDstToGroup from SDF.cl
+  [[nodiscard]]
+  float signedDst(sf::Vector2f point, size_t group) const;
+
+  // What a group looks like to the binning: its box and the exact distance through signedDst()
+  struct GroupRef {
+    const ShapeProgram* program;
+    u32 index;
+    sf::Vector2f center;
+    sf::Vector2f extent;
+  };
+
+  [[nodiscard]]
+  GroupRef group(size_t index) const;
+
+  // Triangles of every shape in its color (polygons as a fan from their first point, exact when convex),
+  // the smooth unions aren't drawn
+  void appendTriangles(std::vector<sf::Vertex>& vertices) const;
+
+private:
+  std::vector<cl_float4> words;
+  std::vector<ShapeGroup> groups;
+  std::vector<cl_float4> groupBounds;
+
+  // Only for drawing
+  std::vector<sf::Color> colors;
+
+  bool inGroup = false;
+  float smoothness = 0.f;
+
+private:
+  // A shape added outside of beginGroup()/endGroup() gets a group of its own, returns whether it was opened here
+  bool beginShape();
+  // Grows the group's box by the shape's and closes the group beginShape() opened
+  void endShape(bool ownGroup, sf::Vector2f min, sf::Vector2f max, sf::Color color);
+  void pushHeader(u32 op, float z, float w);
+};
+
+inline sf::Vector2f extent(const ShapeProgram::GroupRef& group) {
+  return group.extent;
+}
+
+inline float signedDst(sf::Vector2f point, const ShapeProgram::GroupRef& group) {
+  return group.program->signedDst(point, group.index);
+}
+
+} // namespace sdf
+
@@ -0,0 +1,257 @@
+#include "SDF_Scene.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+constexpr char MAGIC[4] = {'S', 'D', 'F', 'S'};
+constexpr size_t TABLE_ALIGNMENT = 16;
+
+struct Header {
+  char magic[4];
+  u32 version;
+  u64 circles;
+  u64 rects;
+  u64 programWords;
+  u64 programGroups;
+  u64 programShapes;
+  u64 reserved[2];
+};
+
+static_assert(sizeof(Header) == 64);
+
+// Byte offset of every table in the file, in the order they are written
+struct Layout {
+  size_t circles, circleColors, rects, rectColors;
+  size_t programWords, programGroups, programGroupBounds, programColors;
+  size_t end;
+};
+
+static size_t alignTable(size_t offset) {
+  return (offset + TABLE_ALIGNMENT - 1) & ~(TABLE_ALIGNMENT - 1);
+}
+
+static Layout layoutOf(const Header& header) {
+  size_t offset = sizeof(Header);
+  auto place = [&](size_t bytes) {
+    size_t at = alignTable(offset);
+    offset = at + bytes;
+    return at;
+  };
+
+  Layout layout;
+  layout.circles = place(sizeof(sdf::Circle) * header.circles);
+  layout.circleColors = place(sizeof(sdf::ShapeColor) * header.circles);
+  layout.rects = place(sizeof(sdf::Rectangle) * header.rects);
+  layout.rectColors = place(sizeof(sdf::ShapeColor) * header.rects);
+  layout.programWords = place(sizeof(cl_float4) * header.programWords);
+  layout.programGroups = place(sizeof(sdf::ShapeGroup) * header.programGroups);
+  layout.programGroupBounds = place(sizeof(cl_float4) * header.programGroups);
+  layout.programColors = place(sizeof(sf::Color) * header.programShapes);
+  layout.end = offset;
+
+  return layout;
+}
+
+template<typename T>
+static std::span<const T> tableAt(const u8* data, size_t offset, size_t count) {
+  return {reinterpret_cast<const T*>(data + offset), count};
+}
+
+// The interpreters trust the instruction stream: the groups have to cover the words in order, every instruction a known
+// op that ends inside its group, every polygon 3 vertices at least, and one color per instruction
+static bool validProgram(const sdf::SceneTables& tables) {
+  std::span<const cl_float4> words = tables.programWords;
+  u64 shapes = 0;
+  u64 w = 0;
+
+  for (const sdf::ShapeGroup& group : tables.programGroups) {
+    if (group.first != w || group.first >= group.end || group.end > words.size())
+      return false;
+
+    while (w < group.end) {
+      const cl_float4& header = words[w];
+      u64 size = 2;
+
+      switch (std::bit_cast<u32>(header.s[0])) {
+        case SHAPE_OP_CIRCLE:
+        case SHAPE_OP_BOX:
+        case SHAPE_OP_CAPSULE:
+          break;
+        case SHAPE_OP_POLYGON: {
+          u32 count = std::bit_cast<u32>(header.s[2]);
+          if (count < 3)
+            return false;
+          size = 1 + (static_cast<u64>(count) + 1) / 2;
+          break;
+        }
+        default:
+          return false;
+      }
+
+      if (size > group.end - w)
+        return false;
+
+      w += size;
+      shapes++;
+    }
+  }
+
+  return w == words.size() && shapes == tables.programColors.size();
+}
+
+namespace sdf {
+
+SceneFile::~SceneFile() {
+  close();
+}
+
+bool SceneFile::open(const std::filesystem::path& path) {
+  close();
+
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE)
+    return false;
+  file = fileHandle;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(fileHandle, &fileSize) || static_cast<size_t>(fileSize.QuadPart) < sizeof(Header)) {
+    close();
+    return false;
+  }
+  size = static_cast<size_t>(fileSize.QuadPart);
+
+  mapping = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping)
+    data = static_cast<const u8*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return false;
+  }
+  size = static_cast<size_t>(info.st_size);
+
+  int flags = MAP_PRIVATE;
+  #ifdef MAP_POPULATE
+    // The tables are read whole right after, faulted in by the kernel in one go
+    flags |= MAP_POPULATE;
+  #endif
+
+  void* mapped = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+  ::close(fd);
+
+  if (mapped != MAP_FAILED)
+    data = static_cast<const u8*>(mapped);
+#endif
+
+  if (!data) {
+    close();
+    return false;
+  }
+
+  Header header;
+  std::memcpy(&header, data, sizeof(Header));
+
+  // Also keeps the table sizes below from overflowing
+  bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION;
+  for (u64 count : {header.circles, header.rects, header.programWords, header.programGroups, header.programShapes})
+    valid = valid && count <= size;
+
+  Layout layout = layoutOf(header);
+  if (!valid || layout.end > size) {
+    close();
+    return false;
+  }
+
+  tables.circles = tableAt<Circle>(data, layout.circles, header.circles);
+  tables.circleColors = tableAt<ShapeColor>(data, layout.circleColors, header.circles);
+  tables.rects = tableAt<Rectangle>(data, layout.rects, header.rects);
+  tables.rectColors = tableAt<ShapeColor>(data, layout.rectColors, header.rects);
+  tables.programWords = tableAt<cl_float4>(data, layout.programWords, header.programWords);
+  tables.programGroups = tableAt<ShapeGroup>(data, layout.programGroups, header.programGroups);
+  tables.programGroupBounds = tableAt<cl_float4>(data, layout.programGroupBounds, header.programGroups);
+  tables.programColors = tableAt<sf::Color>(data, layout.programColors, header.programShapes);
+
+  if (!validProgram(tables)) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void SceneFile::close() {
+#ifdef _WIN32
+  if (data) UnmapViewOfFile(data);
+  if (mapping) CloseHandle(mapping);
+  if (file) CloseHandle(file);
+  mapping = nullptr;
+  file = nullptr;
+#else
+  if (data) munmap(const_cast<u8*>(data), size);
+#endif
+
+  data = nullptr;
+  size = 0;
+  tables = {};
+}
+
+bool SceneFile::write(const std::filesystem::path& path, const SceneTables& tables) {
+  assert(tables.circleColors.size() == tables.circles.size());
+  assert(tables.rectColors.size() == tables.rects.size());
+  assert(tables.programGroupBounds.size() == tables.programGroups.size());
+
+  Header header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.circles = tables.circles.size();
+  header.rects = tables.rects.size();
+  header.programWords = tables.programWords.size();
+  header.programGroups = tables.programGroups.size();
+  header.programShapes = tables.programColors.size();
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  size_t offset = sizeof(Header);
+
+  auto writeTable = [&](auto table) {
+    constexpr char padding[TABLE_ALIGNMENT] = {};
+    out.write(padding, alignTable(offset) - offset);
+    out.write(reinterpret_cast<const char*>(table.data()), table.size_bytes());
+    offset = alignTable(offset) + table.size_bytes();
+  };
+
+  writeTable(tables.circles);
+  writeTable(tables.circleColors);
+  writeTable(tables.rects);
+  writeTable(tables.rectColors);
+  writeTable(tables.programWords);
+  writeTable(tables.programGroups);
+  writeTable(tables.programGroupBounds);
+  writeTable(tables.programColors);
+
+  assert(offset == layoutOf(header).end);
+  return static_cast<bool>(out.flush());
+}
+
+} // namespace sdf
+
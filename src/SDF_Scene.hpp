@@ -0,0 +1,60 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
+#include "SDF_Shapes.hpp"
+#include "utils/types.hpp"
+
+namespace sdf {
+
+// A scene in the layout the backends keep and upload (res/cl/ShapeLayout.h), nothing to convert
+struct SceneTables {
+  std::span<const Circle> circles;
+  std::span<const ShapeColor> circleColors;
+  std::span<const Rectangle> rects;
+  std::span<const ShapeColor> rectColors;
+
+  // See ShapeProgram
+  std::span<const cl_float4> programWords;
+  std::span<const ShapeGroup> programGroups;
+  std::span<const cl_float4> programGroupBounds;
+  std::span<const sf::Color> programColors;
+};
+
+// Binary scene files, read through a memory mapping: the tables point straight into the file.
+// Host byte order, a 64-byte header ("SDFS", format version, counts) then the tables in the order of
+// SceneTables, each starting on a 16-byte boundary
+class SceneFile {
+public:
+  static constexpr u32 VERSION = 1;
+
+  SceneFile() = default;
+  ~SceneFile();
+
+  SceneFile(const SceneFile&) = delete;
+  SceneFile& operator=(const SceneFile&) = delete;
+
+  // False when the file can't be mapped or isn't a scene of this version
+  bool open(const std::filesystem::path& path);
+  void close();
+
+  // Valid until close()
+  [[nodiscard]]
+  const SceneTables& getTables() const { return tables; }
+
+  static bool write(const std::filesystem::path& path, const SceneTables& tables);
+
+private:
+  const u8* data = nullptr;
+  size_t size = 0;
+#ifdef _WIN32
+  void* file = nullptr;
+  void* mapping = nullptr;
+#endif
+
+  SceneTables tables;
+};
+
+} // namespace sdf
+
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "ShapeLayout.h"
+#include "utils/types.hpp"
+
+namespace sdf {
+
+// From the SFML shapes, whatever their origin. No rotation or scale
+inline Circle toCircle(const sf::CircleShape& circle) {
+  float radius = circle.getRadius();
+  sf::Vector2f pos = circle.getPosition();
+  sf::Vector2f origin = circle.getOrigin();
+  pos.x += radius - origin.x;
+  pos.y += radius - origin.y;
+
+  cl_float2 clPos = {{pos.x, pos.y}};
+
+  return {clPos, radius};
+}
+
+inline Rectangle toRectangle(const sf::RectangleShape& rect) {
+  sf::Vector2f origin = rect.getOrigin();
+  sf::Vector2f sizeFromCenter = rect.getGeometricCenter();
+  sf::Vector2f centerGlobal = rect.getPosition() + sizeFromCenter - origin;
+
+  cl_float2 clCenterGlobal = {{centerGlobal.x, centerGlobal.y}};
+  cl_float2 clSizeFromCenter = {{sizeFromCenter.x, sizeFromCenter.y}};
+
+  return {clCenterGlobal, clSizeFromCenter};
+}
+
+inline ShapeColor toColor(sf::Color color) {
+  return {{color.r / 255.f, color.g / 255.f, color.b / 255.f, 1.f}};
+}
+
+inline sf::Color toSfColor(const ShapeColor& color) {
+  auto channel = [](float v) { return static_cast<u8>(std::lround(std::clamp(v, 0.f, 1.f) * 255.f)); };
+  return sf::Color(channel(color.s[0]), channel(color.s[1]), channel(color.s[2]));
+}
+
+// Back to SFML, positioned by the top-left corner
+inline sf::CircleShape toCircleShape(const Circle& circle, const ShapeColor& color) {
+  sf::CircleShape shape(circle.radius);
+  shape.setPosition({circle.center.x - circle.radius, circle.center.y - circle.radius});
+  shape.setFillColor(toSfColor(color));
+  return shape;
+}
+
+inline sf::RectangleShape toRectangleShape(const Rectangle& rect, const ShapeColor& color) {
+  sf::Vector2f halfSize{rect.sizeFromCenter.x, rect.sizeFromCenter.y};
+  sf::RectangleShape shape(halfSize * 2.f);
+  shape.setPosition(sf::Vector2f{rect.center.x, rect.center.y} - halfSize);
+  shape.setFillColor(toSfColor(color));
+  return shape;
+}
+
+// World to field coordinates, for a field at scale of the world: pixel centers map to texel centers,
+// (x + 0.5) * scale = texel + 0.5, and lengths are multiplied by scale
+inline float fieldOffset(float scale) {
+  return 0.5f * scale - 0.5f;
+}
+
+inline Circle toField(const Circle& circle, float scale) {
+  float offset = fieldOffset(scale);
+  return {{{circle.center.x * scale + offset, circle.center.y * scale + offset}}, circle.radius * scale};
+}
+
+inline Rectangle toField(const Rectangle& rect, float scale) {
+  float offset = fieldOffset(scale);
+  return {
+    {{rect.center.x * scale + offset, rect.center.y * scale + offset}},
+    {{rect.sizeFromCenter.x * scale, rect.sizeFromCenter.y * scale}}
+  };
+}
+
+// Host versions of signedDstToCircle/signedDstToRectangle
+inline float signedDst(sf::Vector2f point, const Circle& circle) {
+  float dx = circle.center.x - point.x;
+  float dy = circle.center.y - point.y;
+  return std::sqrt(dx * dx + dy * dy) - circle.radius;
+}
+
+inline float signedDst(sf::Vector2f point, const Rectangle& rect) {
+  float offsetX = std::fabs(point.x - rect.center.x) - rect.sizeFromCenter.x;
+  float offsetY = std::fabs(point.y - rect.center.y) - rect.sizeFromCenter.y;
+  float outsideX = std::max(offsetX, 0.f);
+  float outsideY = std::max(offsetY, 0.f);
+  float unsignedDst = std::sqrt(outsideX * outsideX + outsideY * outsideY);
+  float dstInsideBox = std::min(std::max(offsetX, offsetY), 0.f);
+
+  return unsignedDst + dstInsideBox;
+}
+
+// Half size of the bounding box
+inline sf::Vector2f extent(const Circle& circle)  { return {circle.radius, circle.radius}; }
+inline sf::Vector2f extent(const Rectangle& rect) { return {rect.sizeFromCenter.x, rect.sizeFromCenter.y}; }
+
+// Cheap bound from the bounding box, never more than signedDst
+template<typename Shape>
+inline float lowerDst(sf::Vector2f point, const Shape& shape) {
+  sf::Vector2f ext = extent(shape);
+  float gapX = std::max(std::fabs(point.x - shape.center.x) - ext.x, 0.f);
+  float gapY = std::max(std::fabs(point.y - shape.center.y) - ext.y, 0.f);
+
+  // Inside the box the shape can't be deeper than its smaller half size
+  if (gapX == 0.f && gapY == 0.f)
+    return -std::min(ext.x, ext.y);
+
+  return std::sqrt(gapX * gapX + gapY * gapY);
+}
+
+} // namespace sdf
+
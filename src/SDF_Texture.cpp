@@ -0,0 +1,66 @@
+#include "SDF_Texture.hpp"
+
+#include <SFML/OpenGL.hpp>
+
+// GL 3.0+ enums, the 1.1 headers of some platforms don't have them
+#ifndef GL_R8_SNORM
+  #define GL_R8_SNORM 0x8F94
+#endif
+#ifndef GL_R16F
+  #define GL_R16F 0x822D
+#endif
+#ifndef GL_R32F
+  #define GL_R32F 0x822E
+#endif
+#ifndef GL_HALF_FLOAT
+  #define GL_HALF_FLOAT 0x140B
+#endif
+#ifndef GL_TEXTURE_SWIZZLE_G
+  #define GL_TEXTURE_SWIZZLE_G 0x8E43
+  #define GL_TEXTURE_SWIZZLE_B 0x8E44
+#endif
+
+namespace sdf {
+
+static GLenum pixelType(Format format) {
+  switch (format) {
+    case Format::R8:   return GL_BYTE;
+    case Format::R16F: return GL_HALF_FLOAT;
+    case Format::R32F: return GL_FLOAT;
+    default:           return GL_UNSIGNED_BYTE;
+  }
+}
+
+void allocateTexture(sf::Texture& texture, Format format) {
+  if (format == Format::RGBA8)
+    return;
+
+  GLint internalFormat = format == Format::R8 ? GL_R8_SNORM : format == Format::R16F ? GL_R16F : GL_R32F;
+  sf::Vector2u size = texture.getSize();
+
+  sf::Texture::bind(&texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size.x, size.y, 0, GL_RED, pixelType(format), nullptr);
+
+  // Gray like the RGBA8 field when drawn as a sprite
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+  sf::Texture::bind(nullptr);
+}
+
+void updateTexture(sf::Texture& texture, Format format, const u8* pixels) {
+  if (format == Format::RGBA8) {
+    texture.update(pixels);
+    return;
+  }
+
+  sf::Vector2u size = texture.getSize();
+
+  sf::Texture::bind(&texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, GL_RED, pixelType(format), pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  sf::Texture::bind(nullptr);
+}
+
+} // namespace sdf
+
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "SDF_Format.hpp"
+
+namespace sdf {
+
+// Single channel storage goes around sf::Texture, it only knows RGBA8. The texture must already have its size
+void allocateTexture(sf::Texture& texture, Format format);
+void updateTexture(sf::Texture& texture, Format format, const u8* pixels);
+
+} // namespace sdf
+
@@ -0,0 +1,327 @@
+#include "ShapeContainer.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <numbers>
+#include <sstream>
+
+bool ShapeContainer::load(const std::filesystem::path& path) {
+  sdf::SceneFile sceneFile;
+  if (sceneFile.open(path)) {
+    assign(sceneFile.getTables());
+    return true;
+  }
+
+  std::ifstream file(path);
+  if (!file)
+    return false;
+
+  // Parsed aside, only a complete file replaces the scene
+  std::vector<sf::CircleShape> newCircles;
+  std::vector<sf::RectangleShape> newRects;
+  sdf::ShapeProgram newProgram;
+  bool inGroup = false;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    if (!(fields >> kind) || kind[0] == '#')
+      continue;
+
+    sf::Vector2f pos;
+    int r, g, b;
+
+    if (kind == "smooth") {
+      float smoothness;
+      if (inGroup || !(fields >> smoothness))
+        return false;
+
+      newProgram.beginGroup(smoothness);
+      inGroup = true;
+    } else if (kind == "end") {
+      if (!inGroup)
+        return false;
+
+      newProgram.endGroup();
+      inGroup = false;
+    } else if (kind == "circle") {
+      float radius;
+      if (!(fields >> pos.x >> pos.y >> radius >> r >> g >> b))
+        return false;
+
+      if (inGroup) {
+        newProgram.addCircle(pos + sf::Vector2f{radius, radius}, radius, sf::Color(r, g, b));
+        continue;
+      }
+
+      sf::CircleShape circle(radius);
+      circle.setPosition(pos);
+      circle.setFillColor(sf::Color(r, g, b));
+      newCircles.push_back(circle);
+    } else if (kind == "rect") {
+      sf::Vector2f size;
+      if (!(fields >> pos.x >> pos.y >> size.x >> size.y >> r >> g >> b))
+        return false;
+
+      if (inGroup) {
+        newProgram.addBox(pos + size / 2.f, size / 2.f, 0.f, sf::Color(r, g, b));
+        continue;
+      }
+
+      sf::RectangleShape rect(size);
+      rect.setPosition(pos);
+      rect.setFillColor(sf::Color(r, g, b));
+      newRects.push_back(rect);
+    } else if (kind == "box") {
+      sf::Vector2f halfSize;
+      float degrees;
+      if (!(fields >> pos.x >> pos.y >> halfSize.x >> halfSize.y >> degrees >> r >> g >> b))
+        return false;
+
+      newProgram.addBox(pos, halfSize, degrees * std::numbers::pi_v<float> / 180.f, sf::Color(r, g, b));
+    } else if (kind == "capsule" || kind == "segment") {
+      sf::Vector2f end;
+      float radius = 0.f;
+      if (!(fields >> pos.x >> pos.y >> end.x >> end.y) || (kind == "capsule" && !(fields >> radius)) || !(fields >> r >> g >> b))
+        return false;
+
+      newProgram.addCapsule(pos, end, radius, sf::Color(r, g, b));
+    } else if (kind == "polygon") {
+      size_t count;
+      if (!(fields >> count) || count < 3)
+        return false;
+
+      std::vector<sf::Vector2f> points(count);
+      for (sf::Vector2f& point : points)
+        if (!(fields >> point.x >> point.y))
+          return false;
+
+      if (!(fields >> r >> g >> b))
+        return false;
+
+      newProgram.addPolygon(points, sf::Color(r, g, b));
+    } else {
+      return false;
+    }
+  }
+
+  // A "smooth" without its "end"
+  if (inGroup)
+    return false;
+
+  circles = std::move(newCircles);
+  rects = std::move(newRects);
+  program = std::move(newProgram);
+  holdingShape = nullptr;
+  holdingEntry = NO_ENTRY;
+
+  version = nextVersion();
+  circlesVersion.assign(circles.size(), version);
+  rectsVersion.assign(rects.size(), version);
+  programVersion = version;
+  reindex();
+  return true;
+}
+
+bool ShapeContainer::save(const std::filesystem::path& path) const {
+  std::ofstream file(path);
+  if (!file)
+    return false;
+
+  file.precision(std::numeric_limits<float>::max_digits10);
+
+  for (const sf::CircleShape& shape : circles) {
+    sdf::Circle circle = sdf::toCircle(shape);
+    sf::Color color = shape.getFillColor();
+    file << "circle " << circle.center.x - circle.radius << ' ' << circle.center.y - circle.radius << ' ' << circle.radius << ' '
+         << int(color.r) << ' ' << int(color.g) << ' ' << int(color.b) << '\n';
+  }
+
+  for (const sf::RectangleShape& shape : rects) {
+    sdf::Rectangle rect = sdf::toRectangle(shape);
+    sf::Color color = shape.getFillColor();
+    file << "rect " << rect.center.x - rect.sizeFromCenter.x << ' ' << rect.center.y - rect.sizeFromCenter.y << ' '
+         << 2.f * rect.sizeFromCenter.x << ' ' << 2.f * rect.sizeFromCenter.y << ' '
+         << int(color.r) << ' ' << int(color.g) << ' ' << int(color.b) << '\n';
+  }
+
+  program.writeText(file);
+  return static_cast<bool>(file.flush());
+}
+
+bool ShapeContainer::saveBinary(const std::filesystem::path& path) const {
+  std::vector<sdf::Circle> circleTable(circles.size());
+  std::vector<sdf::ShapeColor> circleColors(circles.size());
+  for (size_t i = 0; i < circles.size(); i++) {
+    circleTable[i] = sdf::toCircle(circles[i]);
+    circleColors[i] = sdf::toColor(circles[i].getFillColor());
+  }
+
+  std::vector<sdf::Rectangle> rectTable(rects.size());
+  std::vector<sdf::ShapeColor> rectColors(rects.size());
+  for (size_t i = 0; i < rects.size(); i++) {
+    rectTable[i] = sdf::toRectangle(rects[i]);
+    rectColors[i] = sdf::toColor(rects[i].getFillColor());
+  }
+
+  return sdf::SceneFile::write(path, {
+    circleTable, circleColors, rectTable, rectColors,
+    program.getWords(), program.getGroups(), program.getGroupBounds(), program.getColors()
+  });
+}
+
+void ShapeContainer::assign(const sdf::SceneTables& tables) {
+  circles.resize(tables.circles.size());
+  for (size_t i = 0; i < circles.size(); i++)
+    circles[i] = sdf::toCircleShape(tables.circles[i], tables.circleColors[i]);
+
+  rects.resize(tables.rects.size());
+  for (size_t i = 0; i < rects.size(); i++)
+    rects[i] = sdf::toRectangleShape(tables.rects[i], tables.rectColors[i]);
+
+  program.assign(tables.programWords, tables.programGroups, tables.programGroupBounds, tables.programColors);
+  holdingShape = nullptr;
+  holdingEntry = NO_ENTRY;
+
+  version = nextVersion();
+  circlesVersion.assign(circles.size(), version);
+  rectsVersion.assign(rects.size(), version);
+  programVersion = version;
+  reindex();
+}
+
+sf::Shape* ShapeContainer::pick(sf::Vector2f point) {
+  u32 picked = pickEntry(point);
+  return picked != NO_ENTRY ? &shapeOf(picked) : nullptr;
+}
+
+u32 ShapeContainer::pickEntry(sf::Vector2f point) {
+  u32 picked = NO_ENTRY;
+
+  // Circles sort before the rectangles
+  grid.query(point, [&](u32 entry) {
+    if (entry < picked && shapeOf(entry).getGlobalBounds().contains(point))
+      picked = entry;
+  });
+
+  return picked;
+}
+
+void ShapeContainer::draw(sf::RenderTarget& target, sf::RenderStates states) const {
+  if (showShapes)
+    drawShapes(target, states);
+}
+
+void ShapeContainer::drawShapes(sf::RenderTarget& target, sf::RenderStates states) const {
+  updateBatch();
+
+  if (batchBuffer.getVertexCount() == batch.size())
+    target.draw(batchBuffer, states);
+  else
+    target.draw(batch.data(), batch.size(), sf::PrimitiveType::Triangles, states);
+}
+
+void ShapeContainer::updateBatch() const {
+  bool programChanged = programVersion > batchVersion;
+  if (programChanged) {
+    programBatch.clear();
+    program.appendTriangles(programBatch);
+  }
+
+  size_t programOffset = circles.size() * CIRCLE_VERTICES + rects.size() * RECT_VERTICES;
+  size_t count = programOffset + programBatch.size();
+  bool rebuild = programChanged || batchCircles != circles.size() || batch.size() != count;
+  if (!rebuild && batchVersion == version)
+    return;
+
+  bool useBuffer = sf::VertexBuffer::isAvailable();
+  batch.resize(count);
+
+  auto upload = [&](size_t offset, size_t count) {
+    if (useBuffer && !rebuild)
+      batchBuffer.update(batch.data() + offset, count, static_cast<unsigned>(offset));
+  };
+
+  for (size_t i = 0; i < circles.size(); i++) {
+    if (rebuild || circlesVersion[i] > batchVersion) {
+      writeCircle(circles[i], batch.data() + i * CIRCLE_VERTICES);
+      upload(i * CIRCLE_VERTICES, CIRCLE_VERTICES);
+    }
+  }
+
+  size_t rectsOffset = circles.size() * CIRCLE_VERTICES;
+  for (size_t i = 0; i < rects.size(); i++) {
+    if (rebuild || rectsVersion[i] > batchVersion) {
+      writeRect(rects[i], batch.data() + rectsOffset + i * RECT_VERTICES);
+      upload(rectsOffset + i * RECT_VERTICES, RECT_VERTICES);
+    }
+  }
+
+  if (rebuild)
+    std::copy(programBatch.begin(), programBatch.end(), batch.begin() + programOffset);
+
+  // Whole buffer at once after a new scene
+  if (useBuffer && rebuild && !batch.empty() && batchBuffer.create(batch.size()))
+    batchBuffer.update(batch.data());
+
+  batchVersion = version;
+  batchCircles = circles.size();
+}
+
+void ShapeContainer::writeCircle(const sf::CircleShape& circle, sf::Vertex* vertices) {
+  const sf::Transform& transform = circle.getTransform();
+  float radius = circle.getRadius();
+  sf::Color color = circle.getFillColor();
+
+  sf::Vector2f center = transform.transformPoint({radius, radius});
+  sf::Vector2f prev = transform.transformPoint({2.f * radius, radius});
+
+  for (size_t i = 1; i <= CIRCLE_POINTS; i++) {
+    float angle = 2.f * std::numbers::pi_v<float> * i / CIRCLE_POINTS;
+    sf::Vector2f next = transform.transformPoint({radius + std::cos(angle) * radius, radius + std::sin(angle) * radius});
+
+    *vertices++ = {center, color, {}};
+    *vertices++ = {prev, color, {}};
+    *vertices++ = {next, color, {}};
+    prev = next;
+  }
+}
+
+void ShapeContainer::writeRect(const sf::RectangleShape& rect, sf::Vertex* vertices) {
+  const sf::Transform& transform = rect.getTransform();
+  sf::Color color = rect.getFillColor();
+
+  sf::Vector2f corners[4];
+  for (size_t i = 0; i < 4; i++)
+    corners[i] = transform.transformPoint(rect.getPoint(i));
+
+  for (size_t i : {0, 1, 2, 0, 2, 3})
+    *vertices++ = {corners[i], color, {}};
+}
+
+u64 ShapeContainer::nextVersion() {
+  static u64 lastVersion = 0;
+  return ++lastVersion;
+}
+
+void ShapeContainer::markChanged(u32 entry) {
+  version = nextVersion();
+
+  if (entry & ShapeGrid::RECT_BIT)
+    rectsVersion[entry & ~ShapeGrid::RECT_BIT] = version;
+  else
+    circlesVersion[entry] = version;
+
+  grid.set(entry, shapeOf(entry).getGlobalBounds());
+}
+
+void ShapeContainer::reindex() {
+  grid.reset(bounds, circles.size(), rects.size());
+
+  for (u32 i = 0; i < circles.size(); i++)
+    grid.set(i, circles[i].getGlobalBounds());
+  for (u32 i = 0; i < rects.size(); i++)
+    grid.set(i | ShapeGrid::RECT_BIT, rects[i].getGlobalBounds());
+}
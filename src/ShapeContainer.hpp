@@ -1,16 +1,47 @@
 #pragma once
 
 #include <algorithm>
+#include <filesystem>
+#include <limits>
+#include <random>
 
+#include "SDF_Program.hpp"
+#include "SDF_Scene.hpp"
+#include "ShapeGrid.hpp"
 #include "defines.hpp"
+#include "utils/types.hpp"
 
 struct ShapeContainer : public sf::Drawable {
   std::vector<sf::RectangleShape> rects;
   std::vector<sf::CircleShape> circles;
   bool showShapes = true;
 
+  // Bumped on every change of the scene (unique across containers). Each shape keeps the version
+  // it was last changed at, so consumers can pick up only what happened since the version they've seen
+  u64 version = 0;
+  std::vector<u64> rectsVersion;
+  std::vector<u64> circlesVersion;
+
+  // Rotated boxes, capsules, polygons and smooth unions (see sdf::ShapeProgram). Only in the distance field and
+  // the drawing, they can't be picked. Replaced as a whole through setProgram(), programVersion is that version
+  sdf::ShapeProgram program;
+  u64 programVersion = 0;
+
   sf::Shape* holdingShape = nullptr;
 
+  // Scene area: generate() places the shapes in it, dragged shapes stay in it. Changed through setBounds() once there are shapes
+  sf::Vector2u bounds = {WIDTH, HEIGHT};
+
+  void setBounds(sf::Vector2u bounds) {
+    this->bounds = bounds;
+    reindex();
+  }
+
+  // generate() draws from its own engine, the same seed gives the same scenes on every platform
+  void seed(u32 value) {
+    rng.seed(value);
+  }
+
   void generate(int numCircles, int numRects, int numWalls) {
     circles.clear();
     for (int i = 0; i < numCircles; i++) {
@@ -54,39 +85,62 @@ struct ShapeContainer : public sf::Drawable {
       rect.setFillColor(sf::Color::Black);
       rects.push_back(rect);
     }
+
+    program.clear();
+
+    version = nextVersion();
+    circlesVersion.assign(circles.size(), version);
+    rectsVersion.assign(rects.size(), version);
+    programVersion = version;
+    reindex();
   };
 
+  void setProgram(sdf::ShapeProgram newProgram) {
+    program = std::move(newProgram);
+    version = nextVersion();
+    programVersion = version;
+  }
+
+  // One shape per line, circle and rect positions are the top-left corner, lines starting with # are skipped:
+  //   circle <x> <y> <radius> <r> <g> <b>
+  //   rect <x> <y> <width> <height> <r> <g> <b>
+  //   box <center x> <center y> <half width> <half height> <degrees> <r> <g> <b>
+  //   capsule <x0> <y0> <x1> <y1> <radius> <r> <g> <b>
+  //   segment <x0> <y0> <x1> <y1> <r> <g> <b>
+  //   polygon <count> <x> <y>... <r> <g> <b>
+  // Shapes between "smooth <radius>" and "end" blend together with a smooth union (circles and rects included).
+  // Binary scenes (sdf::SceneFile) are recognized by their header. The scene is left as it was when it returns false
+  bool load(const std::filesystem::path& path);
+
+  // The text load() reads, exact to the float
+  bool save(const std::filesystem::path& path) const;
+  bool saveBinary(const std::filesystem::path& path) const;
+
+  // Replaces the scene, e.g. with the tables of a mapped sdf::SceneFile
+  void assign(const sdf::SceneTables& tables);
+
   void update(sf::Vector2i mousePos, bool hold) {
     sf::Vector2f mousePosClamped(
-      std::clamp(mousePos.x, 0, (int)WIDTH),
-      std::clamp(mousePos.y, 0, (int)HEIGHT)
+      std::clamp(mousePos.x, 0, (int)bounds.x),
+      std::clamp(mousePos.y, 0, (int)bounds.y)
     );
 
     if (!holdingShape && hold) {
-      for (sf::CircleShape& circle : circles) {
-        if (circle.getGlobalBounds().contains(mousePosClamped)) {
-          holdingShape = &circle;
-          sf::Vector2f shapePos = holdingShape->getPosition();
-          sf::Vector2f distToMous = mousePosClamped - shapePos;
-          holdingShape->setOrigin(distToMous);
-          holdingShape->setPosition(shapePos + distToMous);
-          break;
-        }
-      }
-
-      for (sf::RectangleShape& rect : rects) {
-        if (rect.getGlobalBounds().contains(mousePosClamped)) {
-          holdingShape = &rect;
-          sf::Vector2f shapePos = holdingShape->getPosition();
-          sf::Vector2f distToMous = mousePosClamped - shapePos;
-          holdingShape->setOrigin(distToMous);
-          holdingShape->setPosition(shapePos + distToMous);
-          break;
-        }
+      holdingEntry = pickEntry(mousePosClamped);
+      holdingShape = holdingEntry != NO_ENTRY ? &shapeOf(holdingEntry) : nullptr;
+
+      if (holdingShape) {
+        sf::Vector2f shapePos = holdingShape->getPosition();
+        sf::Vector2f distToMous = mousePosClamped - shapePos;
+        holdingShape->setOrigin(distToMous);
+        holdingShape->setPosition(shapePos + distToMous);
       }
     } else {
       if (hold) {
-        holdingShape->setPosition(mousePosClamped);
+        if (holdingShape->getPosition() != mousePosClamped) {
+          holdingShape->setPosition(mousePosClamped);
+          markChanged(holdingEntry);
+        }
       } else {
         if (holdingShape) {
           sf::Vector2f currOrigin = holdingShape->getOrigin();
@@ -96,28 +150,86 @@ struct ShapeContainer : public sf::Drawable {
           holdingShape->setPosition(shapePos - currOrigin);
         }
         holdingShape = nullptr;
+        holdingEntry = NO_ENTRY;
       }
     }
   }
 
-  void draw(sf::RenderTarget& target, sf::RenderStates states) const override {
-    if (showShapes) {
-      for (const sf::CircleShape& circle : circles) target.draw(circle);
-      for (const sf::RectangleShape& rect : rects)  target.draw(rect);
-    }
+  // The shape under point: the first circle, else the first rectangle
+  sf::Shape* pick(sf::Vector2f point);
+
+  // Index of the shapes' bounding boxes (ShapeGrid::RECT_BIT entries), for range queries
+  [[nodiscard]]
+  const ShapeGrid& getGrid() const { return grid; }
+
+  [[nodiscard]]
+  const sf::Shape& shapeOf(u32 entry) const {
+    if (entry & ShapeGrid::RECT_BIT)
+      return rects[entry & ~ShapeGrid::RECT_BIT];
+    return circles[entry];
+  }
+
+  [[nodiscard]]
+  sf::Shape& shapeOf(u32 entry) {
+    if (entry & ShapeGrid::RECT_BIT)
+      return rects[entry & ~ShapeGrid::RECT_BIT];
+    return circles[entry];
   }
 
+  // All the shapes in one draw call, circles first and the program last. Only the shapes changed since the last draw are written again
+  void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+
+  // Same as draw(), whether the shapes are shown or not (e.g. the scene as obstacles)
+  void drawShapes(sf::RenderTarget& target, sf::RenderStates states = sf::RenderStates::Default) const;
+
 private:
+  // A triangle fan per circle, as many points as sf::CircleShape has by default
+  static constexpr size_t CIRCLE_POINTS = 30;
+  static constexpr size_t CIRCLE_VERTICES = CIRCLE_POINTS * 3;
+  static constexpr size_t RECT_VERTICES = 6;
+
+  static constexpr u32 NO_ENTRY = std::numeric_limits<u32>::max();
+
+  std::mt19937 rng;
+  ShapeGrid grid;
+
+  // Grid entry of holdingShape, which of the two tables it's in
+  u32 holdingEntry = NO_ENTRY;
+
+  // Triangles of every shape, a fixed number of vertices each so a shape can be rewritten in place.
+  // The buffer stays empty (and the vertices are drawn from memory) where vertex buffers aren't available
+  mutable std::vector<sf::Vertex> batch;
+  mutable sf::VertexBuffer batchBuffer{sf::PrimitiveType::Triangles, sf::VertexBuffer::Usage::Dynamic};
+  mutable u64 batchVersion = 0;
+  mutable size_t batchCircles = 0;
+  mutable std::vector<sf::Vertex> programBatch;
+
+  void updateBatch() const;
+
+  static void writeCircle(const sf::CircleShape& circle, sf::Vertex* vertices);
+  static void writeRect(const sf::RectangleShape& rect, sf::Vertex* vertices);
+
+  static u64 nextVersion();
+
+  // Circle or ShapeGrid::RECT_BIT rect index, as in the grid
+  [[nodiscard]]
+  u32 pickEntry(sf::Vector2f point);
+
+  void markChanged(u32 entry);
+  void reindex();
+
   int randBetween(int min, int max) {
-    return rand() % (max - min + 1) + min;
+    return static_cast<int>(rng() % static_cast<u32>(max - min + 1)) + min;
   }
 
   sf::Vector2f randPos() {
-    return sf::Vector2f(rand() % WIDTH, rand() % HEIGHT);
+    return sf::Vector2f(rng() % bounds.x, rng() % bounds.y);
   }
 
   sf::Color randColor() {
-    return sf::Color(rand() % 256, rand() % 256, rand() % 256);
+    u8 r = rng() % 256;
+    u8 g = rng() % 256;
+    u8 b = rng() % 256;
+    return sf::Color(r, g, b);
   }
 };
-
@@ -0,0 +1,58 @@
+#include "ShapeGrid.hpp"
+
+#include <cmath>
+
+ShapeGrid::ShapeGrid(size_t cellSize)
+  : cellSize(cellSize) {}
+
+void ShapeGrid::reset(sf::Vector2u size, size_t circleCount, size_t rectCount) {
+  cellsX = std::max<size_t>((size.x + cellSize - 1) / cellSize, 1);
+  cellsY = std::max<size_t>((size.y + cellSize - 1) / cellSize, 1);
+
+  cells.resize(cellsX * cellsY);
+  for (std::vector<u32>& cell : cells)
+    cell.clear();
+
+  circleRanges.assign(circleCount, {});
+  rectRanges.assign(rectCount, {});
+}
+
+void ShapeGrid::set(u32 entry, sf::FloatRect bounds) {
+  CellRange& range = entry & RECT_BIT ? rectRanges[entry & ~RECT_BIT] : circleRanges[entry];
+  CellRange next = cellRange(bounds);
+  if (next == range)
+    return;
+
+  for (u32 cy = range.y0; cy <= range.y1; cy++) {
+    for (u32 cx = range.x0; cx <= range.x1; cx++) {
+      std::vector<u32>& cell = cells[cy * cellsX + cx];
+      *std::find(cell.begin(), cell.end(), entry) = cell.back();
+      cell.pop_back();
+    }
+  }
+
+  for (u32 cy = next.y0; cy <= next.y1; cy++)
+    for (u32 cx = next.x0; cx <= next.x1; cx++)
+      cells[cy * cellsX + cx].push_back(entry);
+
+  range = next;
+}
+
+ShapeGrid::CellRange ShapeGrid::cellRange(sf::FloatRect bounds) const {
+  auto toCell = [this](float v, size_t count) {
+    float cell = std::floor(v / cellSize);
+    return static_cast<u32>(std::clamp(cell, 0.f, static_cast<float>(count - 1)));
+  };
+
+  return {
+    toCell(bounds.position.x, cellsX),
+    toCell(bounds.position.y, cellsY),
+    toCell(bounds.position.x + bounds.size.x, cellsX),
+    toCell(bounds.position.y + bounds.size.y, cellsY)
+  };
+}
+
+const ShapeGrid::CellRange& ShapeGrid::rangeOf(u32 entry) const {
+  return entry & RECT_BIT ? rectRanges[entry & ~RECT_BIT] : circleRanges[entry];
+}
+
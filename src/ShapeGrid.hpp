@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "utils/types.hpp"
+
+// Uniform grid over the bounding boxes of a scene's shapes, for picking and range queries.
+// Entries are shape indices, with RECT_BIT for the rectangles like TileBinning. Moving a shape only touches
+// the cells it left and the ones it entered, and nothing if it stays in the same cells
+class ShapeGrid {
+public:
+  static constexpr u32 RECT_BIT = 1u << 31;
+  static constexpr size_t DEFAULT_CELL_SIZE = 64;
+
+  explicit ShapeGrid(size_t cellSize = DEFAULT_CELL_SIZE);
+
+  // Empty grid over size pixels, for that many shapes. Shapes reaching out of it go in the border cells
+  void reset(sf::Vector2u size, size_t circleCount, size_t rectCount);
+
+  // Puts the entry in, or moves it to its new bounds
+  void set(u32 entry, sf::FloatRect bounds);
+
+  // fn(entry) once for every entry sharing a cell with area. Candidates only, their bounds may still miss it
+  template<typename Fn>
+  void query(sf::FloatRect area, Fn&& fn) const;
+
+  // fn(entry) for the entries of the cell holding point
+  template<typename Fn>
+  void query(sf::Vector2f point, Fn&& fn) const;
+
+private:
+  // Inclusive, x0 > x1 when the entry isn't in
+  struct CellRange {
+    u32 x0 = 1, y0 = 1, x1 = 0, y1 = 0;
+
+    bool operator==(const CellRange&) const = default;
+  };
+
+  const size_t cellSize;
+  size_t cellsX = 0, cellsY = 0;
+
+  std::vector<std::vector<u32>> cells;
+  std::vector<CellRange> circleRanges;
+  std::vector<CellRange> rectRanges;
+
+private:
+  [[nodiscard]]
+  CellRange cellRange(sf::FloatRect bounds) const;
+
+  [[nodiscard]]
+  const CellRange& rangeOf(u32 entry) const;
+};
+
+template<typename Fn>
+void ShapeGrid::query(sf::FloatRect area, Fn&& fn) const {
+  if (cells.empty())
+    return;
+
+  CellRange areaCells = cellRange(area);
+
+  for (u32 cy = areaCells.y0; cy <= areaCells.y1; cy++) {
+    for (u32 cx = areaCells.x0; cx <= areaCells.x1; cx++) {
+      for (u32 entry : cells[cy * cellsX + cx]) {
+        // Only from the first cell the entry and the area share
+        const CellRange& range = rangeOf(entry);
+        if (std::max(range.x0, areaCells.x0) == cx && std::max(range.y0, areaCells.y0) == cy)
+          fn(entry);
+      }
+    }
+  }
+}
+
+template<typename Fn>
+void ShapeGrid::query(sf::Vector2f point, Fn&& fn) const {
+  if (cells.empty())
+    return;
+
+  CellRange cell = cellRange({point, {0.f, 0.f}});
+  for (u32 entry : cells[cell.y0 * cellsX + cell.x0])
+    fn(entry);
+}
+
@@ -0,0 +1,92 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+  if (threadCount == 0)
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // The caller is the first thread
+  for (size_t i = 1; i < threadCount; i++)
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wakeCv.notify_all();
+
+  for (std::thread& worker : workers)
+    worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const RangeFn& fn, size_t minChunk) {
+  if (count == 0)
+    return;
+
+  size_t threadCount = getThreadCount();
+
+  if (threadCount == 1 || count <= minChunk) {
+    fn(0, count);
+    return;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    job = &fn;
+    jobCount = count;
+    // A few chunks per thread to even out uneven rows
+    chunkSize = std::max(minChunk, count / (threadCount * 4));
+    nextChunk = 0;
+    busyWorkers = workers.size();
+    generation++;
+  }
+  wakeCv.notify_all();
+
+  runChunks();
+
+  std::unique_lock lock(mutex);
+  doneCv.wait(lock, [this] { return busyWorkers == 0; });
+  job = nullptr;
+}
+
+size_t ThreadPool::getThreadCount() const {
+  return workers.size() + 1;
+}
+
+void ThreadPool::workerLoop() {
+  size_t seenGeneration = 0;
+
+  while (true) {
+    {
+      std::unique_lock lock(mutex);
+      wakeCv.wait(lock, [&] { return stopping || generation != seenGeneration; });
+
+      if (stopping)
+        return;
+
+      seenGeneration = generation;
+    }
+
+    runChunks();
+
+    {
+      std::lock_guard lock(mutex);
+      busyWorkers--;
+    }
+    doneCv.notify_one();
+  }
+}
+
+void ThreadPool::runChunks() {
+  while (true) {
+    size_t begin = nextChunk.fetch_add(chunkSize);
+    if (begin >= jobCount)
+      break;
+
+    (*job)(begin, std::min(begin + chunkSize, jobCount));
+  }
+}
+
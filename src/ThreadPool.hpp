@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers for data-parallel loops. The calling thread takes part in the work too
+class ThreadPool {
+public:
+  using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+  // 0 = one thread per hardware core
+  explicit ThreadPool(size_t threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Splits [0, count) into chunks of at least minChunk items and blocks until all of them are processed
+  void parallelFor(size_t count, const RangeFn& fn, size_t minChunk = 1);
+
+  [[nodiscard]]
+  size_t getThreadCount() const;
+
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wakeCv;
+  std::condition_variable doneCv;
+
+  const RangeFn* job = nullptr;
+  size_t jobCount = 0;
+  size_t chunkSize = 0;
+  std::atomic<size_t> nextChunk = 0;
+
+  size_t generation = 0;
+  size_t busyWorkers = 0;
+  bool stopping = false;
+
+private:
+  void workerLoop();
+  void runChunks();
+};
+
@@ -0,0 +1,227 @@
+#include "TileBinning.hpp"
+
+#include <cfloat>
+#include <numeric>
+
+// Covers the difference between the device and host float math
+constexpr float BOUND_MARGIN = 1.f;
+
+// fn(shape) with the circle, rectangle or program group of the entry
+template<typename Scene, typename Fn>
+static auto withShape(const Scene& scene, u32 entry, Fn&& fn) {
+  if (entry & TileBinning::GROUP_BIT)
+    return fn(scene.program.group(entry & ~TileBinning::GROUP_BIT));
+  if (entry & TileBinning::RECT_BIT)
+    return fn(scene.rects[entry & ~TileBinning::RECT_BIT]);
+  return fn(scene.circles[entry]);
+}
+
+TileBinning::TileBinning(size_t width, size_t height, size_t tileSize)
+  : tileSize(tileSize),
+    tilesX((width + tileSize - 1) / tileSize),
+    tilesY((height + tileSize - 1) / tileSize),
+    binsX((tilesX + BIN_TILES - 1) / BIN_TILES),
+    binsY((tilesY + BIN_TILES - 1) / BIN_TILES),
+    binOffsets(binsX * binsY + 1),
+    tileUpperDst(tilesX * tilesY) {}
+
+void TileBinning::build(const std::vector<sdf::Circle>& circles, const std::vector<sdf::Rectangle>& rects, const sdf::ShapeProgram& program, const std::vector<u32>& requestedTiles) {
+  const Scene scene{circles, rects, program};
+
+  fillBins(scene);
+  calcUpperBounds(scene);
+
+  circleStamps.assign(circles.size(), 0);
+  rectStamps.assign(rects.size(), 0);
+  groupStamps.assign(program.getGroupCount(), 0);
+
+  tiles.clear();
+  offsets.clear();
+  entries.clear();
+
+  for (u32 tile : requestedTiles)
+    gather(tile, scene);
+
+  offsets.push_back(entries.size());
+}
+
+void TileBinning::buildFullScan(const std::vector<u32>& requestedTiles) {
+  tiles.resize(requestedTiles.size());
+  for (size_t i = 0; i < requestedTiles.size(); i++)
+    tiles[i] = requestedTiles[i] | FULL_SCAN_BIT;
+
+  offsets.assign(requestedTiles.size() + 1, 0);
+  entries.clear();
+}
+
+const std::vector<u32>& TileBinning::getTiles() const {
+  return tiles;
+}
+
+const std::vector<u32>& TileBinning::getOffsets() const {
+  return offsets;
+}
+
+const std::vector<u32>& TileBinning::getEntries() const {
+  return entries;
+}
+
+void TileBinning::fillBins(const Scene& scene) {
+  // Counting sort: count, prefix sum, fill
+  std::fill(binOffsets.begin(), binOffsets.end(), 0);
+
+  auto forEachBin = [this](const auto& shape, auto fn) {
+    sf::Vector2f center{shape.center.x, shape.center.y};
+    sf::Vector2f ext = sdf::extent(shape);
+    size_t bx0, by0, bx1, by1;
+    binRange(center - ext, center + ext, bx0, by0, bx1, by1);
+
+    for (size_t by = by0; by <= by1; by++)
+      for (size_t bx = bx0; bx <= bx1; bx++)
+        fn(by * binsX + bx);
+  };
+
+  const size_t groupCount = scene.program.getGroupCount();
+
+  for (const sdf::Circle& circle : scene.circles) forEachBin(circle, [&](size_t bin) { binOffsets[bin + 1]++; });
+  for (const sdf::Rectangle& rect : scene.rects)  forEachBin(rect,   [&](size_t bin) { binOffsets[bin + 1]++; });
+  for (size_t i = 0; i < groupCount; i++)          forEachBin(scene.program.group(i), [&](size_t bin) { binOffsets[bin + 1]++; });
+
+  std::partial_sum(binOffsets.begin(), binOffsets.end(), binOffsets.begin());
+  binEntries.resize(binOffsets.back());
+
+  std::vector<u32> cursor(binOffsets.begin(), binOffsets.end() - 1);
+
+  for (u32 i = 0; i < scene.circles.size(); i++) forEachBin(scene.circles[i], [&](size_t bin) { binEntries[cursor[bin]++] = i; });
+  for (u32 i = 0; i < scene.rects.size(); i++)   forEachBin(scene.rects[i],   [&](size_t bin) { binEntries[cursor[bin]++] = i | RECT_BIT; });
+  for (u32 i = 0; i < groupCount; i++)           forEachBin(scene.program.group(i), [&](size_t bin) { binEntries[cursor[bin]++] = i | GROUP_BIT; });
+}
+
+void TileBinning::calcUpperBounds(const Scene& scene) {
+  const float half = (tileSize - 1) * 0.5f;
+  const float halfDiagonal = half * std::sqrt(2.f);
+
+  // Seed from the shapes overlapping the tile's bin, nothing in the tile is further than this from the shape
+  for (size_t ty = 0; ty < tilesY; ty++) {
+    for (size_t tx = 0; tx < tilesX; tx++) {
+      const sf::Vector2f center{tx * tileSize + half, ty * tileSize + half};
+      const size_t bin = (ty / BIN_TILES) * binsX + tx / BIN_TILES;
+
+      float upper = FLT_MAX;
+      auto tighten = [&](const auto& shape) {
+        // Can't do better than the current bound, skip the exact distance
+        if (sdf::lowerDst(center, shape) + halfDiagonal >= upper)
+          return;
+
+        upper = std::min(upper, sdf::signedDst(center, shape) + halfDiagonal);
+      };
+
+      for (u32 i = binOffsets[bin]; i < binOffsets[bin + 1]; i++)
+        withShape(scene, binEntries[i], tighten);
+
+      tileUpperDst[ty * tilesX + tx] = upper;
+    }
+  }
+
+  // Spread to the tiles without shapes nearby: every pixel of a tile has a twin in the neighbour
+  // shifted by the distance between them, so the neighbour's bound plus that distance holds too
+  const float axial = static_cast<float>(tileSize);
+  const float diagonal = axial * std::sqrt(2.f);
+
+  auto relax = [&](size_t tx, size_t ty, int dx, int dy, float cost) {
+    int nx = static_cast<int>(tx) + dx;
+    int ny = static_cast<int>(ty) + dy;
+    if (nx < 0 || ny < 0 || nx >= (int)tilesX || ny >= (int)tilesY)
+      return;
+
+    float& upper = tileUpperDst[ty * tilesX + tx];
+    upper = std::min(upper, tileUpperDst[ny * tilesX + nx] + cost);
+  };
+
+  for (size_t ty = 0; ty < tilesY; ty++) {
+    for (size_t tx = 0; tx < tilesX; tx++) {
+      relax(tx, ty, -1,  0, axial);
+      relax(tx, ty,  0, -1, axial);
+      relax(tx, ty, -1, -1, diagonal);
+      relax(tx, ty,  1, -1, diagonal);
+    }
+  }
+
+  for (size_t ty = tilesY; ty-- > 0;) {
+    for (size_t tx = tilesX; tx-- > 0;) {
+      relax(tx, ty,  1, 0, axial);
+      relax(tx, ty,  0, 1, axial);
+      relax(tx, ty,  1, 1, diagonal);
+      relax(tx, ty, -1, 1, diagonal);
+    }
+  }
+}
+
+void TileBinning::gather(u32 tile, const Scene& scene) {
+  const size_t first = entries.size();
+  const float half = (tileSize - 1) * 0.5f;
+  const float halfDiagonal = half * std::sqrt(2.f);
+  const float upper = tileUpperDst[tile] + BOUND_MARGIN;
+
+  tiles.push_back(tile);
+  offsets.push_back(first);
+
+  // No shapes at all
+  if (upper >= FLT_MAX)
+    return;
+
+  const sf::Vector2f center{(tile % tilesX) * tileSize + half, (tile / tilesX) * tileSize + half};
+
+  // The closest shape is within this distance from the center, so its box overlaps the square around it
+  const float radius = std::max(upper + halfDiagonal, 0.f);
+  const sf::Vector2f radiusV{radius, radius};
+
+  size_t bx0, by0, bx1, by1;
+  binRange(center - radiusV, center + radiusV, bx0, by0, bx1, by1);
+
+  for (size_t by = by0; by <= by1; by++) {
+    for (size_t bx = bx0; bx <= bx1; bx++) {
+      const size_t bin = by * binsX + bx;
+
+      for (u32 i = binOffsets[bin]; i < binOffsets[bin + 1]; i++) {
+        u32 entry = binEntries[i];
+        u32 index = entry & ~(RECT_BIT | GROUP_BIT);
+
+        u32& stamp = entry & GROUP_BIT ? groupStamps[index] : entry & RECT_BIT ? rectStamps[index] : circleStamps[index];
+        if (stamp == tile + 1)
+          continue;
+        stamp = tile + 1;
+
+        // Bounding box first, it is a cheap lower bound of the exact distance
+        bool kept = withShape(scene, entry, [&](const auto& shape) {
+          return sdf::lowerDst(center, shape) - halfDiagonal <= upper && sdf::signedDst(center, shape) - halfDiagonal <= upper;
+        });
+
+        if (kept)
+          entries.push_back(entry);
+      }
+    }
+  }
+
+  // However long, the list is never more than the scene. Only when it is the whole scene the tile goes through
+  // the tables directly, the same shapes without the indirection
+  const size_t sceneShapes = scene.circles.size() + scene.rects.size() + scene.program.getGroupCount();
+  if (entries.size() - first == sceneShapes) {
+    entries.resize(first);
+    tiles.back() |= FULL_SCAN_BIT;
+  }
+}
+
+void TileBinning::binRange(sf::Vector2f min, sf::Vector2f max, size_t& bx0, size_t& by0, size_t& bx1, size_t& by1) const {
+  const float binSize = static_cast<float>(tileSize * BIN_TILES);
+
+  auto toBin = [binSize](float v, size_t count) {
+    return static_cast<size_t>(std::clamp(std::floor(v / binSize), 0.f, static_cast<float>(count - 1)));
+  };
+
+  bx0 = toBin(min.x, binsX);
+  by0 = toBin(min.y, binsY);
+  bx1 = toBin(max.x, binsX);
+  by1 = toBin(max.y, binsY);
+}
+
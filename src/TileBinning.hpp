@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+#include "SDF_Program.hpp"
+#include "SDF_Shapes.hpp"
+#include "utils/types.hpp"
+
+// Pre-pass of the SDF evaluation: finds for every tile the shapes that can be the closest one to any of its pixels.
+//
+// Shapes are put in coarse bins (BIN_TILES x BIN_TILES tiles) by their bounding boxes. Each tile gets an upper bound
+// of the field inside it (from the shapes of its own bin, then spread to the neighbours), and only the shapes whose
+// lower bound over the tile doesn't exceed it are kept. The lists are conservative, the result is exact.
+class TileBinning {
+public:
+  // Tile entries: the tile evaluates every shape instead of a list (its list would hold every shape of the scene)
+  static constexpr u32 FULL_SCAN_BIT = 1u << 31;
+  // Shape entries: index into the rectangles or the groups of the shape program instead of the circles
+  static constexpr u32 RECT_BIT = 1u << 31;
+  static constexpr u32 GROUP_BIT = 1u << 30;
+
+  static constexpr size_t BIN_TILES = 4;
+
+  TileBinning(size_t width, size_t height, size_t tileSize);
+
+  // Lists for the given tiles (index = tileY * tilesX + tileX)
+  void build(const std::vector<sdf::Circle>& circles, const std::vector<sdf::Rectangle>& rects, const sdf::ShapeProgram& program, const std::vector<u32>& requestedTiles);
+
+  // Every given tile evaluates every shape
+  void buildFullScan(const std::vector<u32>& requestedTiles);
+
+  // Requested tiles, with FULL_SCAN_BIT where needed
+  [[nodiscard]]
+  const std::vector<u32>& getTiles() const;
+
+  // Shapes of getTiles()[i] are getEntries()[getOffsets()[i]..getOffsets()[i + 1]]
+  [[nodiscard]]
+  const std::vector<u32>& getOffsets() const;
+
+  [[nodiscard]]
+  const std::vector<u32>& getEntries() const;
+
+private:
+  const size_t tileSize;
+  const size_t tilesX, tilesY;
+  const size_t binsX, binsY;
+
+  std::vector<u32> binOffsets;
+  std::vector<u32> binEntries;
+  std::vector<float> tileUpperDst;
+
+  // Tile + 1 of the last time a shape was listed, to skip duplicates from neighbouring bins
+  std::vector<u32> circleStamps;
+  std::vector<u32> rectStamps;
+  std::vector<u32> groupStamps;
+
+  std::vector<u32> tiles;
+  std::vector<u32> offsets;
+  std::vector<u32> entries;
+
+private:
+  struct Scene {
+    const std::vector<sdf::Circle>& circles;
+    const std::vector<sdf::Rectangle>& rects;
+    const sdf::ShapeProgram& program;
+  };
+
+  void fillBins(const Scene& scene);
+  void calcUpperBounds(const Scene& scene);
+  void gather(u32 tile, const Scene& scene);
+
+  // Range of bins overlapped by [min, max] in pixels
+  void binRange(sf::Vector2f min, sf::Vector2f max, size_t& bx0, size_t& by0, size_t& bx1, size_t& by1) const;
+};
+
@@ -0,0 +1,21 @@
+#include "Upsample.hpp"
+
+#include "utils/utils.hpp"
+
+Upsample::Upsample()
+  : shader(fspath("src/upsample.frag"), sf::Shader::Type::Fragment) {}
+
+void Upsample::draw(sf::RenderTarget& target, const sf::Texture& source, const sf::Texture& guide) {
+  sf::Vector2f targetSize(target.getSize());
+  rect.setSize(targetSize);
+
+  shader.setUniform("u_source", source);
+  shader.setUniform("u_guide", guide);
+  shader.setUniform("u_sourceSize", sf::Glsl::Vec2(source.getSize()));
+  shader.setUniform("u_targetSize", sf::Glsl::Vec2(targetSize));
+
+  // Every pixel is written
+  sf::RenderStates states(&shader);
+  states.blendMode = sf::BlendNone;
+  target.draw(rect, states);
+}
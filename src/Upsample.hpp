@@ -0,0 +1,17 @@
+#pragma once
+
+#include "utils/types.hpp"
+
+// Brings a pass rendered at a fraction of the resolution (the lighting at SDF_Backend::setScale) back to the
+// target's, edge-aware: see src/upsample.frag
+class Upsample {
+public:
+  Upsample();
+
+  // Covers the whole target with source, guide is the scene at the target's resolution
+  void draw(sf::RenderTarget& target, const sf::Texture& source, const sf::Texture& guide);
+
+private:
+  sf::Shader shader;
+  sf::RectangleShape rect;
+};
@@ -1,18 +1,40 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <format>
 
+#include "Profiler.hpp"
+#include "RadianceCascades.hpp"
 #include "Ray.hpp"
+#include "SDF_Backend.hpp"
+#include "SDF_Texture.hpp"
 #include "ShapeContainer.hpp"
+#include "Upsample.hpp"
 #include "utils/utils.hpp"
 
+// Of the field and the lighting passes for a window, at least a pixel
+static sf::Vector2u fieldSizeOf(sf::Vector2u windowSize, float scale) {
+  return {
+    std::max(1u, static_cast<unsigned int>(std::lround(windowSize.x * scale))),
+    std::max(1u, static_cast<unsigned int>(std::lround(windowSize.y * scale)))
+  };
+}
+
 int main() {
   // Assuming the executable is launching from its own directory
   CHDIR("../../..");
 
-  srand(static_cast<unsigned int>(time(nullptr)));
-  sf::RenderWindow window = sf::RenderWindow(sf::VideoMode({WIDTH, HEIGHT}), "MyProgram");
+  // Resizable. The field and the lighting passes run at renderScales[renderScale] of the window (F cycles it), upsampled
+  // back to the window with the scene as the guide: the shapes stay sharp, the light is what gets cheaper
+  sf::Vector2u windowSize{WIDTH, HEIGHT};
+  sf::RenderWindow window = sf::RenderWindow(sf::VideoMode(windowSize), "MyProgram");
   window.setFramerateLimit(144);
 
+  const float renderScales[] = {1.f, 0.5f, 0.25f};
+  size_t renderScale = 0;
+  sf::Vector2u fieldSize = windowSize;
+
   std::string fontPath = "res/fonts/Minecraft.otf";
   sf::Font font;
   if (!font.openFromFile(fontPath))
@@ -24,20 +46,37 @@ int main() {
   int numRects = 3;
   int numWalls = 2;
   ShapeContainer shapeContainer;
+  shapeContainer.seed(static_cast<u32>(time(nullptr)));
   shapeContainer.generate(numCircles, numRects, numWalls);
 
-  // OpenCL related
-  OCL_SDF ocl(WIDTH, HEIGHT);
-  sf::Texture sdfTexture({WIDTH, HEIGHT});
+  // SDF related (OpenCL when a GPU is present, native CPU otherwise). J switches to Jump Flooding and back.
+  // Half floats: signed, sub-pixel precise and half of the RGBA8 traffic
+  const sdf::Format sdfFormat = sdf::Format::R16F;
+  // Startup time, mostly the OpenCL build (from the binary cache after the first launch)
+  sf::Clock startupClock;
+  std::unique_ptr<SDF_Backend> sdf = SDF_Backend::create(fieldSize.x, fieldSize.y, SDF_Backend::Type::Auto, sdfFormat);
+  float startupMs = startupClock.getElapsedTime().asSeconds() * 1000.f;
+  u64 seedsVersion = 0;
+
+  // Written by OpenCL directly when the device shares it with GL, uploaded from getPixels() otherwise
+  sf::Texture sdfTexture(fieldSize);
+  sdf::allocateTexture(sdfTexture, sdfFormat);
   sf::Sprite sdfSprite(sdfTexture);
+  bool sdfShared = sdf->shareTexture(sdfTexture);
+
+  // Otherwise the frame is drawn with the field of an earlier run while the device computes the current one
+  const size_t sdfPipelineDepth = 2;
+  if (!sdfShared)
+    sdf->setPipelineDepth(sdfPipelineDepth);
+  printf("SDF backend: %s%s, ready in %.1f ms\n", sdf->getName(), sdfShared ? " (shared texture)" : "", startupMs);
 
   // ----- Ray march shader ------------------------- //
 
   sf::Shader rmShader(fspath("src/rm.frag"), sf::Shader::Type::Fragment);
-  sf::RectangleShape rmRect({WIDTH, HEIGHT});
-  sf::RenderTexture shapesTexture({WIDTH, HEIGHT});
-  sf::RenderTexture previousFrame({WIDTH, HEIGHT});
-  sf::RenderTexture currentFrame({WIDTH, HEIGHT});
+  sf::RectangleShape rmRect(sf::Vector2f{fieldSize});
+  sf::RenderTexture shapesTexture(windowSize);
+  sf::RenderTexture previousFrame(fieldSize);
+  sf::RenderTexture currentFrame(fieldSize);
   sf::Texture blueNoise("res/tex/noise/LDR_LLL1_0.png");
 
   int raysPerPixel = 32;
@@ -46,11 +85,38 @@ int main() {
   rmShader.setUniform("u_baseTexture", shapesTexture.getTexture());
   rmShader.setUniform("u_sdfTexture", sdfTexture);
   rmShader.setUniform("u_blueNoiseTexture", blueNoise);
-  rmShader.setUniform("u_resolution", sf::Glsl::Vec2{WIDTH, HEIGHT});
+  rmShader.setUniform("u_resolution", sf::Glsl::Vec2(fieldSize));
   rmShader.setUniform("u_raysPerPixel", raysPerPixel);
   rmShader.setUniform("u_stepsPerRay", stepsPerRay);
   rmShader.setUniform("u_epsilon", epsilon);
 
+  // G accumulates the rays over the frames: new rays where the history is short or noisy, next to none where it has
+  // converged. The scene or the field changing starts over. The rays of the short histories follow the frame time,
+  // halved above the budget and doubled back (up to raysPerPixel) well under it
+  bool accumulate = false;
+  bool historyReset = true;
+  int accumulateRays = raysPerPixel;
+  int frame = 0;
+  const float accumulateBudgetMs = 1000.f / 60.f;
+  const int accumulateMinRays = 1;
+  rmShader.setUniform("u_accumulate", 0);
+  rmShader.setUniform("u_minRays", accumulateMinRays);
+  rmShader.setUniform("u_maxSamples", 1020); // Multiple of 255, whole samples in the 8 bit alpha
+  rmShader.setUniform("u_refreshFrames", 16);
+  rmShader.setUniform("u_varianceThreshold", 0.5f);
+
+  // ----- Radiance cascades ----------------------- //
+
+  // Noise-free at a fixed cost, same scene and field as the ray march shader
+  RadianceCascades radianceCascades(fieldSize);
+  printf("Radiance cascades: %d\n", radianceCascades.getCascadeCount());
+
+  // The ray march pass back to the window's size when it's smaller, the cascades have their own
+  Upsample upsample;
+
+  // The scene at the field's size for Jump Flooding, drawn from the shapes whether they're shown or not
+  sf::RenderTexture seedsTexture;
+
   // ----- Texts ------------------------------------ //
 
   sf::Text baseText(font, "baseText", 12);
@@ -73,10 +139,24 @@ int main() {
   epsilonText.setPosition(stepsPerRayText.getPosition() + textOffset);
   epsilonText.setString(std::format("epsilon = {}", epsilon));
 
+  sf::Text accumulateText(baseText);
+  accumulateText.setPosition(epsilonText.getPosition() + textOffset);
+  accumulateText.setString("accumulate = off");
+
+  // Reads of the field by the single ray
+  sf::Text rayStatsText(baseText);
+  rayStatsText.setPosition(sf::Vector2f{5.f, windowSize.y - 20.f});
+
+  // P toggles it, T writes the recent frames as a Chrome trace
+  const char* tracePath = "trace.json";
+  bool showProfiler = false;
+  sf::Text profilerText(baseText);
+  profilerText.setPosition(sf::Vector2f{windowSize.x - 300.f, 5.f});
+
   // ------------------------------------------------ //
 
   // Single ray
-  Ray ray(sf::Vector2f{20.f, 20.f}, 64);
+  Ray ray(sf::Vector2f{20.f, 20.f}, 64, windowSize);
 
   // Loop related
   sf::Clock clock;
@@ -89,16 +169,71 @@ int main() {
     size_t frameIdx = 0;
   } avg;
 
-  shapesTexture.clear();
+  Profiler profiler;
+
+  shapesTexture.clear(sf::Color::Transparent);
   shapesTexture.draw(shapeContainer);
   shapesTexture.display();
 
+  auto createSdf = [&](SDF_Backend::Type type) {
+    // The old backend lets go of the shared texture before the new one takes it
+    sdf.reset();
+    sdf = SDF_Backend::create(fieldSize.x, fieldSize.y, type, sdfFormat);
+    sdf->setScale(static_cast<float>(fieldSize.x) / windowSize.x);
+    sdfShared = sdf->shareTexture(sdfTexture);
+    if (!sdfShared)
+      sdf->setPipelineDepth(sdfPipelineDepth);
+    printf("SDF backend: %s%s, %ux%u\n", sdf->getName(), sdfShared ? " (shared texture)" : "", fieldSize.x, fieldSize.y);
+    seedsVersion = 0;
+    historyReset = true;
+  };
+
+  // Everything sized after the window or the field, after a resize or a new render scale. Once per frame at most,
+  // after the last of its events (dragging a window edge sends one per mouse move)
+  bool resizePending = false;
+  auto resize = [&]() {
+    fieldSize = fieldSizeOf(windowSize, renderScales[renderScale]);
+    window.setView(sf::View(sf::FloatRect({0.f, 0.f}, sf::Vector2f(windowSize))));
+
+    // Nothing may still share the texture when its storage is replaced
+    SDF_Backend::Type sdfType = sdf->usesSeeds() ? SDF_Backend::Type::JumpFlood : SDF_Backend::Type::Auto;
+    sdf.reset();
+
+    if (!sdfTexture.resize(fieldSize))
+      error("Can't create a {}x{} SDF texture", fieldSize.x, fieldSize.y);
+    sdf::allocateTexture(sdfTexture, sdfFormat);
+    createSdf(sdfType);
+
+    radianceCascades.resize(fieldSize);
+
+    if (!previousFrame.resize(fieldSize) || !currentFrame.resize(fieldSize) || !shapesTexture.resize(windowSize))
+      error("Can't create the {}x{} frame textures", windowSize.x, windowSize.y);
+    rmRect.setSize(sf::Vector2f(fieldSize));
+    rmShader.setUniform("u_resolution", sf::Glsl::Vec2(fieldSize));
+
+    shapeContainer.setBounds(windowSize);
+    shapesTexture.clear(sf::Color::Transparent);
+    shapesTexture.draw(shapeContainer);
+    shapesTexture.display();
+    rmShader.setUniform("u_baseTexture", shapesTexture.getTexture());
+
+    ray.setBounds(windowSize);
+    rayStatsText.setPosition(sf::Vector2f{5.f, windowSize.y - 20.f});
+    profilerText.setPosition(sf::Vector2f{windowSize.x - 300.f, 5.f});
+  };
+
   while (window.isOpen()) {
     // ----- Events ----------------------------------- //
 
     while (const std::optional event = window.pollEvent()) {
       if (event->is<sf::Event::Closed>()) {
         window.close();
+      } else if (const auto* resized = event->getIf<sf::Event::Resized>()) {
+        // Minimized
+        if (resized->size.x > 0 && resized->size.y > 0 && resized->size != windowSize) {
+          windowSize = resized->size;
+          resizePending = true;
+        }
       } else if (const auto* keyPressed = event->getIf<sf::Event::KeyPressed>()) {
         switch (keyPressed->scancode) {
           case sf::Keyboard::Scancode::Q:
@@ -106,14 +241,37 @@ int main() {
             break;
           case sf::Keyboard::Scancode::R:
             shapeContainer.generate(numCircles, numRects, numWalls);
-            shapesTexture.clear();
+            shapesTexture.clear(sf::Color::Transparent);
             shapesTexture.draw(shapeContainer);
             shapesTexture.display();
             rmShader.setUniform("u_baseTexture", shapesTexture.getTexture());
+            historyReset = true;
+            break;
+          case sf::Keyboard::Scancode::J:
+            createSdf(sdf->usesSeeds() ? SDF_Backend::Type::Auto : SDF_Backend::Type::JumpFlood);
+            break;
+          case sf::Keyboard::Scancode::F:
+            renderScale = (renderScale + 1) % std::size(renderScales);
+            resizePending = true;
             break;
           case sf::Keyboard::Scancode::C:
             shapeContainer.showShapes = !shapeContainer.showShapes;
             break;
+          case sf::Keyboard::Scancode::G:
+            accumulate = !accumulate;
+            accumulateRays = raysPerPixel;
+            rmShader.setUniform("u_accumulate", accumulate ? 1 : 0);
+            rmShader.setUniform("u_raysPerPixel", accumulate ? accumulateRays : raysPerPixel);
+            accumulateText.setString(accumulate ? std::format("accumulate = on, {} rays max", accumulateRays) : "accumulate = off");
+            historyReset = true;
+            break;
+          case sf::Keyboard::Scancode::P:
+            showProfiler = !showProfiler;
+            break;
+          case sf::Keyboard::Scancode::T:
+            if (profiler.writeChromeTrace(tracePath))
+              printf("Trace written to %s\n", tracePath);
+            break;
           case sf::Keyboard::Scancode::Num1:
             drawMode = 0;
             break;
@@ -123,14 +281,19 @@ int main() {
           case sf::Keyboard::Scancode::Num3:
             drawMode = 2;
             break;
+          case sf::Keyboard::Scancode::Num4:
+            drawMode = 3;
+            break;
           case sf::Keyboard::Scancode::W:
             raysPerPixel = std::min(raysPerPixel * 2, 1024);
-            rmShader.setUniform("u_raysPerPixel", raysPerPixel);
+            accumulateRays = std::min(accumulateRays, raysPerPixel);
+            rmShader.setUniform("u_raysPerPixel", accumulate ? accumulateRays : raysPerPixel);
             raysPerPixelText.setString(std::format("raysPerPixel = {}", raysPerPixel));
             break;
           case sf::Keyboard::Scancode::S:
             raysPerPixel = std::max(raysPerPixel / 2, 1);
-            rmShader.setUniform("u_raysPerPixel", raysPerPixel);
+            accumulateRays = std::min(accumulateRays, raysPerPixel);
+            rmShader.setUniform("u_raysPerPixel", accumulate ? accumulateRays : raysPerPixel);
             raysPerPixelText.setString(std::format("raysPerPixel = {}", raysPerPixel));
             break;
           case sf::Keyboard::Scancode::A:
@@ -161,23 +324,34 @@ int main() {
           epsilon *= 10.f;
 
         rmShader.setUniform("u_epsilon", epsilon);
+        historyReset = true;
         epsilonText.setString(std::format("epsilon = {}", epsilon));
       }
     }
 
+    if (resizePending) {
+      resize();
+      resizePending = false;
+    }
+
     // ----- Update meta ------------------------------ //
 
     dt = clock.restart().asSeconds();
     mousePos = sf::Mouse::getPosition(window);
 
     if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)) {
+      u64 version = shapeContainer.version;
       shapeContainer.update(mousePos, true);
 
-      shapesTexture.clear();
-      shapesTexture.draw(shapeContainer);
-      shapesTexture.display();
+      // Holding a shape still keeps the lighting
+      if (shapeContainer.version != version) {
+        shapesTexture.clear(sf::Color::Transparent);
+        shapesTexture.draw(shapeContainer);
+        shapesTexture.display();
 
-      rmShader.setUniform("u_baseTexture", shapesTexture.getTexture());
+        rmShader.setUniform("u_baseTexture", shapesTexture.getTexture());
+        historyReset = true;
+      }
     }
 
     size_t fps = static_cast<size_t>(1.f / dt);
@@ -190,19 +364,76 @@ int main() {
       avg.fps /= avg.frameIdx;
       avg.ms /= avg.frameIdx;
       avg.frameIdx = 1;
+
+      // Refreshed at the same pace, sorting the windows every frame isn't free
+      if (showProfiler)
+        profilerText.setString(std::format("{} fps, {:.2f} ms\n{}", avg.fps, avg.ms, profiler.summary()));
+
+      if (accumulate) {
+        int rays = accumulateRays;
+        if (avg.ms > accumulateBudgetMs)
+          rays = std::max(rays / 2, accumulateMinRays);
+        else if (avg.ms < 0.5f * accumulateBudgetMs)
+          rays = std::min(rays * 2, raysPerPixel);
+
+        if (rays != accumulateRays) {
+          accumulateRays = rays;
+          rmShader.setUniform("u_raysPerPixel", accumulateRays);
+          accumulateText.setString(std::format("accumulate = on, {} rays max", accumulateRays));
+        }
+      }
     }
 
     // ----- Update objects --------------------------- //
 
-    // TODO: Update only if at least one shape were changed (TODO: Update only the updated shape?)
-    ocl.updateCirclesBuffer(shapeContainer.circles);
-    ocl.updateRectsBuffer(shapeContainer.rects);
-    ocl.run();
+    // No-ops while the scene doesn't change
+    {
+      Profiler::Scope scope(profiler, "shape upload");
+      sdf->updateShapes(shapeContainer);
+      if (sdf->usesSeeds() && seedsVersion != shapeContainer.version) {
+        // Drawn with a transparent background, everything opaque is an obstacle
+        if (seedsTexture.getSize() != fieldSize && !seedsTexture.resize(fieldSize))
+          error("Can't create a {}x{} seeds texture", fieldSize.x, fieldSize.y);
+
+        seedsTexture.setView(sf::View(sf::FloatRect({0.f, 0.f}, sf::Vector2f(windowSize))));
+        seedsTexture.clear(sf::Color::Transparent);
+        shapeContainer.drawShapes(seedsTexture);
+        seedsTexture.display();
+
+        sdf->updateSeeds(seedsTexture.getTexture().copyToImage());
+        seedsVersion = shapeContainer.version;
+      }
+    }
 
-    const u8* sdfPixels = ocl.getPixels();
+    {
+      Profiler::Scope scope(profiler, "sdf run");
+      if (sdf->run() && sdfShared)
+        historyReset = true;
+    }
 
+    // Takes what the device has finished so far, the rest shows up in the next frames
+    {
+      Profiler::Scope scope(profiler, "sdf fetch");
+      if (!sdfShared && sdf->fetchPixels(SDF_Backend::Fetch::LatestReady)) {
+        sdf::updateTexture(sdfTexture, sdfFormat, sdf->getPixels(SDF_Backend::Fetch::LatestReady));
+        historyReset = true;
+      }
+    }
+
+    SDF_Backend::DeviceTimes deviceTimes = sdf->takeDeviceTimes();
+    if (deviceTimes.kernel > 0.)   profiler.record("sdf kernel", deviceTimes.kernel, deviceTimes.kernelStart);
+    if (deviceTimes.readback > 0.) profiler.record("sdf readback", deviceTimes.readback, deviceTimes.readbackStart);
+
+    // The ray is the only CPU reader of the field, with a shared texture this is the only readback
     ray.update(mousePos);
-    ray.march(sdfPixels);
+    if (drawMode == 0) {
+      Profiler::Scope scope(profiler, "ray march");
+      const u8* sdfPixels = sdf->getPixels(SDF_Backend::Fetch::LatestReady);
+      ray.march(sdfPixels, sdfFormat, fieldSize);
+
+      const Ray::Stats& rayStats = ray.getStats();
+      rayStatsText.setString(std::format("{} steps, {} fetches", rayStats.steps, rayStats.fetches));
+    }
 
     // ----- Draw ------------------------------------- //
 
@@ -212,39 +443,67 @@ int main() {
       case 0: {
         window.draw(ray);
         window.draw(shapeContainer);
-        window.display();
+        window.draw(rayStatsText);
         break;
       }
       case 1: {
-        sdfTexture.update(sdfPixels);
         sdfSprite = sf::Sprite(sdfTexture);
+        sdfSprite.setScale(sf::Vector2f(windowSize).componentWiseDiv(sf::Vector2f(fieldSize)));
         window.draw(sdfSprite);
         window.draw(shapeContainer);
-        window.display();
         break;
       }
       case 2: {
-        sdfTexture.update(sdfPixels);
-
-        currentFrame.clear();
-        currentFrame.draw(rmRect, &rmShader);
-        currentFrame.display();
+        // The GL passes are only timed as far as their submission, the driver queues them
+        {
+          Profiler::Scope scope(profiler, "shader submit");
+          rmShader.setUniform("u_historyReset", historyReset ? 1 : 0);
+          rmShader.setUniform("u_frame", frame++);
+          historyReset = false;
+
+          currentFrame.clear();
+          currentFrame.draw(rmRect, &rmShader);
+          currentFrame.display();
+        }
 
+        // The alpha holds the sample counts when accumulating, copied as is
         const sf::Sprite currentFrameSprite(currentFrame.getTexture());
 
-        window.draw(currentFrameSprite);
+        if (fieldSize == windowSize) {
+          window.draw(currentFrameSprite, sf::BlendNone);
+        } else {
+          Profiler::Scope scope(profiler, "upsample submit");
+          upsample.draw(window, currentFrame.getTexture(), shapesTexture.getTexture());
+        }
+
         window.draw(raysPerPixelText);
         window.draw(stepsPerRayText);
         window.draw(epsilonText);
-        window.display();
+        window.draw(accumulateText);
 
-        previousFrame.clear();
-        previousFrame.draw(currentFrameSprite);
-        previousFrame.display();
+        {
+          Profiler::Scope scope(profiler, "frame copy submit");
+          previousFrame.clear();
+          previousFrame.draw(currentFrameSprite, sf::BlendNone);
+          previousFrame.display();
+        }
 
         rmShader.setUniform("u_baseTexture", previousFrame.getTexture());
         break;
       }
+      case 3: {
+        Profiler::Scope scope(profiler, "cascades submit");
+        radianceCascades.render(window, shapesTexture.getTexture(), sdfTexture);
+        break;
+      }
+    }
+
+    if (showProfiler)
+      window.draw(profilerText);
+
+    {
+      Profiler::Scope scope(profiler, "present");
+      window.display();
     }
   }
 }
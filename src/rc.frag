@@ -0,0 +1,92 @@
+#version 330
+
+#define PI 3.14159265359f
+#define TAU (2.f * PI)
+
+// One cascade of Radiance Cascades. Cascade n has a probe every 2^n pixels, each probe a block of
+// 2^(n+1) x 2^(n+1) texels, one per ray (4^(n+1) directions). Its rays cover the interval
+// [baseInterval * (4^n - 1) / 3, baseInterval * (4^(n+1) - 1) / 3], cascade n + 1 continues where it stops.
+// The cascades are built from the top one down, each merging the one above it.
+// All positions are in pixels with the GL orientation (origin bottom-left)
+
+uniform sampler2D u_baseTexture;  // Scene colors, anything drawn emits its color
+uniform sampler2D u_sdfTexture;   // distance / width in R
+uniform sampler2D u_upperCascade; // Cascade n + 1, not read by the top one
+uniform vec2 u_resolution;
+uniform int u_cascade;
+uniform int u_cascadeCount;
+uniform float u_baseInterval;
+uniform int u_stepsPerInterval;
+
+float sceneDst(vec2 pos) {
+  return texture2D(u_sdfTexture, vec2(pos.x, u_resolution.y - pos.y) / u_resolution).r * u_resolution.x;
+}
+
+// Radiance gathered along the interval, alpha = 1 if the ray got through
+vec4 marchInterval(vec2 origin, vec2 dir, float start, float end) {
+  float t = start;
+
+  for (int i = 0; i < u_stepsPerInterval && t < end; i++) {
+    vec2 pos = origin + dir * t;
+
+    // Nothing comes from outside of the screen
+    if (pos.x < 0.f || pos.y < 0.f || pos.x >= u_resolution.x || pos.y >= u_resolution.y)
+      return vec4(0.f);
+
+    float dist = sceneDst(pos);
+    if (dist < 0.5f) {
+      // The edge pixel can still be background, one pixel further is inside
+      return vec4(texture2D(u_baseTexture, (pos + dir) / u_resolution).rgb, 0.f);
+    }
+
+    t += dist;
+  }
+
+  return vec4(0.f, 0.f, 0.f, 1.f);
+}
+
+void main() {
+  ivec2 texel = ivec2(gl_FragCoord.xy);
+  int blockSize = 2 << u_cascade;
+  float spacing = float(1 << u_cascade);
+
+  ivec2 probe = texel / blockSize;
+  ivec2 inBlock = texel % blockSize;
+  int rayIdx = inBlock.y * blockSize + inBlock.x;
+  int rayCount = blockSize * blockSize;
+
+  vec2 origin = (vec2(probe) + 0.5f) * spacing;
+  float start = u_baseInterval * (pow(4.f, float(u_cascade)) - 1.f) / 3.f;
+  float end = u_baseInterval * (pow(4.f, float(u_cascade + 1)) - 1.f) / 3.f;
+  float angle = (float(rayIdx) + 0.5f) * TAU / float(rayCount);
+
+  vec4 radiance = marchInterval(origin, vec2(cos(angle), sin(angle)), start, end);
+
+  if (radiance.a > 0.f && u_cascade < u_cascadeCount - 1) {
+    // The 4 closest upper probes, bilinear, each averaging the 4 rays this one splits into
+    int upperBlock = blockSize * 2;
+    ivec2 upperProbes = textureSize(u_upperCascade, 0) / upperBlock;
+    vec2 upperPos = origin / (spacing * 2.f) - 0.5f;
+    ivec2 upperBase = ivec2(floor(upperPos));
+    vec2 weight = fract(upperPos);
+
+    vec4 upper[4];
+    for (int j = 0; j < 4; j++) {
+      ivec2 upperProbe = clamp(upperBase + ivec2(j & 1, j >> 1), ivec2(0), upperProbes - 1);
+
+      upper[j] = vec4(0.f);
+      for (int k = 0; k < 4; k++) {
+        int upperRay = rayIdx * 4 + k;
+        upper[j] += texelFetch(u_upperCascade, upperProbe * upperBlock + ivec2(upperRay % upperBlock, upperRay / upperBlock), 0);
+      }
+      upper[j] /= 4.f;
+    }
+
+    vec4 merged = mix(mix(upper[0], upper[1], weight.x), mix(upper[2], upper[3], weight.x), weight.y);
+    radiance.rgb += radiance.a * merged.rgb;
+    radiance.a *= merged.a;
+  }
+
+  gl_FragColor = radiance;
+}
+
@@ -0,0 +1,23 @@
+#version 330
+
+// Fluence of every pixel: the average of the 4 rays of its cascade 0 probe. Shapes keep their own color
+
+uniform sampler2D u_baseTexture;
+uniform sampler2D u_cascade0;
+uniform vec2 u_resolution;
+
+void main() {
+  ivec2 probe = ivec2(gl_FragCoord.xy);
+
+  vec3 light = vec3(0.f);
+  for (int k = 0; k < 4; k++)
+    light += texelFetch(u_cascade0, probe * 2 + ivec2(k & 1, k >> 1), 0).rgb;
+  light /= 4.f;
+
+  vec4 base = texture2D(u_baseTexture, gl_FragCoord.xy / u_resolution);
+  if (base.a > 0.f)
+    light = base.rgb;
+
+  gl_FragColor = vec4(light, 1.f);
+}
+
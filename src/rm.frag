@@ -4,15 +4,37 @@
 #define TAU (2.f * PI)
 
 uniform sampler2D u_baseTexture;
-uniform sampler2D u_sdfTexture;
+uniform sampler2D u_sdfTexture; // distance / width in R, signed unless stored as RGBA8
 uniform sampler2D u_blueNoiseTexture;
 uniform vec2 u_resolution;
 uniform int u_stepsPerRay;
 uniform int u_raysPerPixel;
 uniform float u_epsilon;
 
+// Accumulation: u_baseTexture is last frame's result, rgb the mean of every ray so far and alpha the sample count
+// (rays) over u_maxSamples. Short histories get up to u_raysPerPixel rays, converged pixels u_minRays once every
+// u_refreshFrames frames, more rays when the first ones disagree. u_historyReset drops every history
+uniform int u_accumulate;
+uniform int u_historyReset;
+uniform int u_frame;
+uniform int u_minRays;
+uniform int u_maxSamples;
+uniform int u_refreshFrames;
+uniform float u_varianceThreshold;
+
+#define GOLDEN_RATIO 0.618034f
+// Below this many rays a frame's spread says nothing, a single ray has none
+#define MIN_OUTLIER_RAYS 8
+
 vec2 uvStep = 1.f / u_resolution;
 
+vec3 hitColor(vec2 pix, vec2 dir) {
+  return max(
+    texture2D(u_baseTexture, pix).rgb,
+    texture2D(u_baseTexture, pix - (dir * uvStep)).rgb
+  );
+}
+
 vec3 rayMarch(vec2 pix, vec2 dir) {
   float dist = 0.f;
   for (int i = 0; i < u_stepsPerRay; i++) {
@@ -21,38 +43,110 @@ vec3 rayMarch(vec2 pix, vec2 dir) {
 
     bool offscreen = pix.x > 1.f || pix.x < 0.f || pix.y > 1.f || pix.y < 0.f;
 
-    if (dist < u_epsilon || offscreen) {
-      return max(
-        texture2D(u_baseTexture, pix).rgb,
-        texture2D(u_baseTexture, pix - (dir * uvStep)).rgb
-      );
-    }
+    if (dist < u_epsilon || offscreen)
+      return hitColor(pix, dir);
   }
 
   return vec3(0.f);
 }
 
+vec3 marchAngle(vec2 uv, float angle) {
+  vec2 rayDir = vec2(cos(angle), sin(angle));
+  return rayMarch(uv, rayDir);
+}
+
+float brightnessOf(vec3 color) {
+  return max(color.r, max(color.g, color.b));
+}
+
+// Rays first..first + count - 1 of the golden ratio sequence from start: evenly spread for any count
+void traceRays(vec2 uv, float start, int first, int count, inout vec3 sum, inout float sumB, inout float sumB2) {
+  for (int i = first; i < first + count; i++) {
+    vec3 rayColor = marchAngle(uv, TAU * fract(start + i * GOLDEN_RATIO));
+    float b = brightnessOf(rayColor);
+    sum += rayColor;
+    sumB += b;
+    sumB2 += b * b;
+  }
+}
+
+vec4 shadeAccumulated(vec2 uv, float noise) {
+  vec4 history = texture2D(u_baseTexture, uv);
+  float maxSamples = float(u_maxSamples);
+  float samples = u_historyReset != 0 ? 0.f : floor(history.a * maxSamples + 0.5f);
+
+  int rays;
+  if (samples >= maxSamples) {
+    // Each pixel once every u_refreshFrames frames, spread by the noise
+    bool refresh = fract(noise + float(u_frame) / u_refreshFrames) < 1.f / u_refreshFrames;
+    rays = refresh ? u_minRays : 0;
+  } else {
+    rays = max(u_minRays, int(u_raysPerPixel * (1.f - samples / maxSamples)));
+  }
+
+  if (rays == 0)
+    return history;
+
+  float start = fract(noise + u_frame * GOLDEN_RATIO);
+  vec3 sum = vec3(0.f);
+  float sumB = 0.f;
+  float sumB2 = 0.f;
+  traceRays(uv, start, 0, rays, sum, sumB, sumB2);
+
+  // Relative spread of the first rays, as many again where it's high
+  float mean = sumB / rays;
+  float variance = max(sumB2 / rays - mean * mean, 0.f);
+  if (sqrt(variance) > u_varianceThreshold * max(mean, 1e-3f) && rays < u_raysPerPixel) {
+    int extra = min(rays, u_raysPerPixel - rays);
+    traceRays(uv, start, rays, extra, sum, sumB, sumB2);
+    rays += extra;
+
+    mean = sumB / rays;
+    variance = max(sumB2 / rays - mean * mean, 0.f);
+  }
+
+  // The lighting changed here if this frame is far outside of what the history predicts, keep this frame's weight only.
+  // Scene changes reset the history anyway (u_historyReset), the refresh rays of converged pixels are never enough
+  float deviation = abs(mean - brightnessOf(history.rgb));
+  if (rays >= MIN_OUTLIER_RAYS && deviation > 4.f * sqrt(variance / rays) + 2.f / 255.f)
+    samples = min(samples, float(rays));
+
+  vec3 light = (history.rgb * samples + sum) / (samples + rays);
+  samples = min(samples + rays, maxSamples);
+
+  // Dithered, so 8 bits per channel converge to the mean instead of sticking a step away from it
+  float dither = (fract(noise + u_frame * 0.754877f) - 0.5f) / 255.f;
+  return vec4(light + dither, samples / maxSamples);
+}
+
 void main() {
   vec2 uv = vec2(gl_FragCoord.xy) / u_resolution;
 
   float dist = texture2D(u_sdfTexture, vec2(uv.x, 1.f - uv.y)).r;
   vec3 light = texture2D(u_baseTexture, uv).rgb;
 
-  if (dist >= u_epsilon) {
-    float brightness = max(light.r, max(light.g, light.b));
-    float noise = TAU * texture2D(u_blueNoiseTexture, uv).r;
-    float step = TAU / u_raysPerPixel;
+  if (dist < u_epsilon) {
+    gl_FragColor = vec4(light, 1.f);
+    return;
+  }
+
+  float noise = texture2D(u_blueNoiseTexture, uv).r;
+
+  if (u_accumulate != 0) {
+    gl_FragColor = shadeAccumulated(uv, noise);
+    return;
+  }
 
-    for (float angle = 0.f; angle < TAU; angle += step) {
-      vec2 rayDir = vec2(cos(angle + noise), sin(angle + noise));
-      vec3 hitColor = rayMarch(uv, rayDir);
-      light += hitColor;
-      brightness += max(hitColor.r, max(hitColor.g, hitColor.b));
-    }
+  float brightness = max(light.r, max(light.g, light.b));
+  float step = TAU / u_raysPerPixel;
 
-    light = light / brightness * brightness / u_raysPerPixel;
+  for (float angle = 0.f; angle < TAU; angle += step) {
+    vec3 rayColor = marchAngle(uv, angle + TAU * noise);
+    light += rayColor;
+    brightness += max(rayColor.r, max(rayColor.g, rayColor.b));
   }
 
+  light = light / brightness * brightness / u_raysPerPixel;
   gl_FragColor = vec4(light, 1.f);
 }
 
@@ -0,0 +1,48 @@
+#version 330
+
+// Joint bilateral upsample of a pass rendered below the target's resolution, guided by the scene at the target's.
+// Pixels of a shape keep the shape's own color, the others blend their 2x2 closest source texels bilinearly,
+// without the texels whose center is inside a shape: the light doesn't bleed across the edges
+
+uniform sampler2D u_source;
+uniform sampler2D u_guide; // Alpha > 0 inside the shapes
+uniform vec2 u_sourceSize;
+uniform vec2 u_targetSize;
+
+void main() {
+  vec2 uv = gl_FragCoord.xy / u_targetSize;
+
+  vec4 guide = texture2D(u_guide, uv);
+  if (guide.a > 0.f) {
+    gl_FragColor = vec4(guide.rgb, 1.f);
+    return;
+  }
+
+  // Between the centers of the closest texels
+  vec2 pos = uv * u_sourceSize - 0.5f;
+  ivec2 first = ivec2(floor(pos));
+  vec2 f = pos - floor(pos);
+  ivec2 last = ivec2(u_sourceSize) - 1;
+
+  vec3 sum = vec3(0.f);
+  float weights = 0.f;
+  for (int k = 0; k < 4; k++) {
+    ivec2 offset = ivec2(k & 1, k >> 1);
+    ivec2 texel = clamp(first + offset, ivec2(0), last);
+    vec2 bilinear = mix(1.f - f, f, vec2(offset));
+
+    float inside = texture2D(u_guide, (vec2(texel) + 0.5f) / u_sourceSize).a > 0.f ? 1.f : 0.f;
+    float w = bilinear.x * bilinear.y * (1.f - inside);
+
+    sum += w * texelFetch(u_source, texel, 0).rgb;
+    weights += w;
+  }
+
+  // Every neighbour inside a shape, a thin gap: the closest one
+  if (weights < 1e-4f)
+    sum = texelFetch(u_source, clamp(ivec2(uv * u_sourceSize), ivec2(0), last), 0).rgb;
+  else
+    sum /= weights;
+
+  gl_FragColor = vec4(sum, 1.f);
+}